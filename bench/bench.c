@@ -0,0 +1,254 @@
+#include "measure.h"
+#include "synth.h"
+#include "../src/common/intern.h"
+#include "../src/common/util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_DEFAULT_THRESHOLD 10.0
+#define BENCH_DEFAULT_OUTPUT "bench.json"
+
+// Stages faster than this in the baseline are too noisy to be compared
+#define BENCH_MIN_SECONDS 0.001
+
+#define BENCH_MAX_RESULTS 256
+
+struct result {
+        char corpus[64];
+        enum bench_stage stage;
+        double seconds;
+};
+
+// Results are reported here. The compiler's own progress messages on stdout are silenced
+static FILE *report;
+
+static void usage(void)
+{
+        fprintf(report, "Usage: polymine_bench [options] [corpus.poly ...]\n"
+                        "  --iterations N   Compile every corpus N times, the fastest run counts (default %d)\n"
+                        "  --synthetic N    Functions in the synthetic corpus, 0 to leave it out (default %d)\n"
+                        "  --output FILE    Write the results as JSON (default %s)\n"
+                        "  --baseline FILE  Compare against the results of an earlier run and fail on regressions\n"
+                        "  --threshold P    Slowdown against the baseline that counts as a regression, in percent (default %.0f)\n",
+                BENCH_DEFAULT_ITERATIONS, SYNTH_DEFAULT_FUNCTIONS, BENCH_DEFAULT_OUTPUT, BENCH_DEFAULT_THRESHOLD);
+}
+
+static double per_second(size_t amount, double seconds)
+{
+        return seconds > 0 ? amount / seconds : 0;
+}
+
+// One line per stage. Baselines are read back line by line, so each result has to stay on a line of its own
+static void write_measurement(FILE *out, const char *corpus, struct measurement *m, _Bool *first)
+{
+        for (enum bench_stage stage = 0; stage < STAGE_COUNT; stage++) {
+                double seconds = m->seconds[stage];
+                size_t bytes = stage == STAGE_GENERATE ? m->output : m->bytes;
+
+                fprintf(out, *first ? "    " : ",\n    ");
+                *first = false;
+
+                fprintf(out, "{\"corpus\": \"%s\", \"stage\": \"%s\", \"seconds\": %.9f, \"mb_per_second\": %.3f, ",
+                        corpus, stage_string(stage), seconds, per_second(bytes, seconds) / 1e6);
+
+                if (stage == STAGE_LEX)
+                        fprintf(out, "\"tokens\": %zu, \"tokens_per_second\": %.0f}", m->tokens,
+                                per_second(m->tokens, seconds));
+                else
+                        fprintf(out, "\"nodes\": %zu, \"nodes_per_second\": %.0f}", m->nodes,
+                                per_second(m->nodes, seconds));
+        }
+}
+
+static size_t read_baseline(const char *path, struct result *results)
+{
+        FILE *in = fopen(path, "r");
+
+        if (!in)
+                return 0;
+
+        char line[512];
+        char stage[16];
+        size_t count = 0;
+
+        while (count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), in)) {
+                struct result *r = &results[count];
+
+                if (sscanf(line, " {\"corpus\": \"%63[^\"]\", \"stage\": \"%15[^\"]\", \"seconds\": %lf",
+                           r->corpus, stage, &r->seconds) != 3)
+                        continue;
+
+                for (r->stage = 0; r->stage < STAGE_COUNT; r->stage++)
+                        if (strcmp(stage, stage_string(r->stage)) == 0)
+                                break;
+
+                if (r->stage != STAGE_COUNT)
+                        count++;
+        }
+
+        fclose(in);
+
+        return count;
+}
+
+// Returns the number of regressions
+static size_t compare(struct result *baseline, size_t baseline_count, struct result *results, size_t count,
+                      double threshold)
+{
+        size_t regressions = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                struct result *r = &results[i];
+
+                for (size_t j = 0; j < baseline_count; j++) {
+                        struct result *b = &baseline[j];
+
+                        if (b->stage != r->stage || strcmp(b->corpus, r->corpus) != 0)
+                                continue;
+
+                        if (b->seconds < BENCH_MIN_SECONDS)
+                                break;
+
+                        double change = (r->seconds / b->seconds - 1) * 100;
+                        _Bool regressed = change > threshold;
+
+                        fprintf(report, "%-24s %-9s %+7.1f%%%s\n", r->corpus, stage_string(r->stage), change,
+                                regressed ? "  REGRESSION" : "");
+
+                        if (regressed)
+                                regressions++;
+
+                        break;
+                }
+        }
+
+        return regressions;
+}
+
+int main(int argc, char **argv)
+{
+        report = measure_silence();
+
+        size_t iterations = BENCH_DEFAULT_ITERATIONS;
+        double threshold = BENCH_DEFAULT_THRESHOLD;
+        const char *output = BENCH_DEFAULT_OUTPUT;
+        const char *baseline = NULL;
+        struct synth_shape shape = SYNTH_DEFAULT_SHAPE;
+
+        const char *corpora[argc + 1];
+        size_t corpus_count = 0;
+
+        for (int i = 1; i < argc; i++) {
+                _Bool has_value = i + 1 < argc;
+
+                if (strcmp(argv[i], "--iterations") == 0 && has_value)
+                        iterations = strtoul(argv[++i], NULL, 10);
+                else if (strcmp(argv[i], "--synthetic") == 0 && has_value)
+                        shape.functions = strtoul(argv[++i], NULL, 10);
+                else if (strcmp(argv[i], "--output") == 0 && has_value)
+                        output = argv[++i];
+                else if (strcmp(argv[i], "--baseline") == 0 && has_value)
+                        baseline = argv[++i];
+                else if (strcmp(argv[i], "--threshold") == 0 && has_value)
+                        threshold = strtod(argv[++i], NULL);
+                else if (argv[i][0] == '-') {
+                        usage();
+                        return 2;
+                } else
+                        corpora[corpus_count++] = argv[i];
+        }
+
+        if (iterations == 0)
+                iterations = 1;
+
+        intern_init();
+
+        char *synthetic = NULL;
+        char synthetic_name[64];
+
+        if (shape.functions > 0) {
+                if (!(synthetic = synth_file(&shape))) {
+                        fprintf(report, "Could not write the synthetic corpus.\n");
+                        return 1;
+                }
+
+                snprintf(synthetic_name, sizeof(synthetic_name), "synthetic-%zu", shape.functions);
+                corpora[corpus_count++] = synthetic;
+        }
+
+        FILE *out = fopen(output, "w");
+
+        if (!out) {
+                fprintf(report, "Could not open \"%s\".\n", output);
+                return 1;
+        }
+
+        fprintf(out, "{\n  \"iterations\": %zu,\n  \"threads\": %zu,\n  \"results\": [\n", iterations, cpu_count());
+
+        struct result results[BENCH_MAX_RESULTS];
+        size_t result_count = 0;
+        int status = 0;
+        _Bool first = true;
+
+        for (size_t i = 0; i < corpus_count; i++) {
+                const char *name = corpora[i] == synthetic ? synthetic_name : corpora[i];
+                const char *slash = strrchr(name, '/');
+                struct measurement m;
+
+                name = slash ? slash + 1 : name;
+
+                if (!measure_file(corpora[i], iterations, &m)) {
+                        fprintf(report, "%s does not compile. Run polymine on it for details.\n", corpora[i]);
+                        status = 1;
+                        continue;
+                }
+
+                write_measurement(out, name, &m, &first);
+
+                fprintf(report, "%-24s %8zu bytes  lex %.2f Mtok/s  lex+parse %.2f Mnode/s  analyze %.3f ms  generate %.3f ms\n",
+                        name, m.bytes, per_second(m.tokens, m.seconds[STAGE_LEX]) / 1e6,
+                        per_second(m.nodes, m.seconds[STAGE_PARSE]) / 1e6, m.seconds[STAGE_ANALYZE] * 1e3,
+                        m.seconds[STAGE_GENERATE] * 1e3);
+
+                for (enum bench_stage stage = 0; stage < STAGE_COUNT && result_count < BENCH_MAX_RESULTS; stage++) {
+                        struct result *r = &results[result_count++];
+
+                        snprintf(r->corpus, sizeof(r->corpus), "%s", name);
+                        r->stage = stage;
+                        r->seconds = m.seconds[stage];
+                }
+        }
+
+        fprintf(out, "\n  ]\n}\n");
+        fclose(out);
+
+        if (synthetic) {
+                unlink(synthetic);
+                free(synthetic);
+        }
+
+        if (baseline) {
+                struct result previous[BENCH_MAX_RESULTS];
+                size_t previous_count = read_baseline(baseline, previous);
+
+                // A gate without a baseline would pass no matter what
+                if (previous_count == 0) {
+                        fprintf(report, "No baseline results in \"%s\". Record them with the bench_baseline target.\n",
+                                baseline);
+                        status = 1;
+                } else if (compare(previous, previous_count, results, result_count, threshold) > 0) {
+                        fprintf(report, "Front-end performance regressed by more than %.0f%%.\n", threshold);
+                        status = 1;
+                }
+        }
+
+        astdtype_free_all();
+        intern_free();
+        fclose(report);
+
+        return status;
+}
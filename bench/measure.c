@@ -0,0 +1,149 @@
+#include "measure.h"
+#include "../src/common/io.h"
+#include "../src/common/ast.h"
+#include "../src/syntax/lexer.h"
+#include "../src/syntax/parser.h"
+#include "../src/syntax/syntax.h"
+#include "../src/semantics/semutil.h"
+#include "../src/codegen/codegen.h"
+
+#include <time.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char *stage_string(enum bench_stage stage)
+{
+        switch (stage) {
+                case STAGE_LEX:
+                        return "lex";
+                case STAGE_PARSE:
+                        return "lex+parse";
+                case STAGE_ANALYZE:
+                        return "analyze";
+                case STAGE_GENERATE:
+                        return "generate";
+                default:
+                        return "unknown";
+        }
+}
+
+FILE *measure_silence(void)
+{
+        fflush(stdout);
+
+        FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+        int null = open("/dev/null", O_WRONLY);
+
+        if (null >= 0) {
+                dup2(null, STDOUT_FILENO);
+                close(null);
+        }
+
+        return report ? report : stderr;
+}
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void record(struct measurement *m, enum bench_stage stage, double elapsed)
+{
+        if (elapsed < m->seconds[stage])
+                m->seconds[stage] = elapsed;
+}
+
+// One compilation of the file, start to finish
+static _Bool measure_once(const char *path, struct measurement *m)
+{
+        struct input_handle handle = empty_input_handle;
+
+        if (!input_read(path, &handle))
+                return false;
+
+        struct arena arena;
+        arena_init(&arena, ARENA_CHUNK_SIZE);
+        ast_arena = &arena;
+
+        _Bool success = false;
+        struct lexer lex;
+        struct lxtok tok;
+        double start;
+
+        m->bytes = handle.length;
+        m->tokens = 0;
+
+        lexer_init(&lex, &handle);
+        start = now();
+
+        while (!lexer_empty(&lex) && lexer_next(&lex, &tok)) {
+                m->tokens++;
+                lxtok_free(&tok);
+        }
+
+        record(m, STAGE_LEX, now() - start);
+
+        struct parser p;
+        size_t nodes = astnode_count;
+
+        lexer_init(&lex, &handle);
+        start = now();
+
+        parser_init(&p, &lex);
+        struct astnode *program = parse(&p);
+
+        record(m, STAGE_PARSE, now() - start);
+        m->nodes = astnode_count - nodes;
+
+        if (!program)
+                goto end;
+
+        struct semantics sem;
+        semantics_init(&sem, program);
+
+        start = now();
+
+        if (!analyze_program(&sem, program))
+                goto end;
+
+        record(m, STAGE_ANALYZE, now() - start);
+
+        struct emitter out;
+        struct codegen gen;
+
+        emitter_init_memory(&out);
+        codegen_init(&gen, program, sem.stuff, &out);
+
+        start = now();
+        gen_generate(&gen);
+        record(m, STAGE_GENERATE, now() - start);
+
+        m->output = out.length;
+        emitter_free(&out);
+
+        success = true;
+
+        end:
+
+        parser_free(&p);
+        arena_free(&arena);
+        ast_arena = NULL;
+        input_free(&handle);
+
+        return success;
+}
+
+_Bool measure_file(const char *path, size_t iterations, struct measurement *m)
+{
+        for (size_t i = 0; i < STAGE_COUNT; i++)
+                m->seconds[i] = DBL_MAX;
+
+        for (size_t i = 0; i < iterations; i++)
+                if (!measure_once(path, m))
+                        return false;
+
+        return true;
+}
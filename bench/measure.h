@@ -0,0 +1,41 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+enum bench_stage {
+        STAGE_LEX = 0,
+        STAGE_PARSE,    // Lexing included, the parser pulls tokens as it goes
+        STAGE_ANALYZE,
+        STAGE_GENERATE,
+
+        STAGE_COUNT
+};
+
+const char *stage_string(enum bench_stage);
+
+/**
+ * Send everything the compiler prints to standard output to /dev/null, so only the results of a
+ * benchmark remain. Returns a stream to the original standard output for those.
+ **/
+FILE *measure_silence(void);
+
+// The fastest time of every stage over all iterations, along with the size of the corpus
+struct measurement {
+        double seconds[STAGE_COUNT];
+        size_t bytes;   // Of the source
+        size_t tokens;
+        size_t nodes;   // Created by the parser
+        size_t output;  // Bytes of generated C code
+};
+
+/**
+ * Compile a file the given number of times, timing each stage on its own. Lexing is additionally timed in
+ * a pass of its own, as the parser pulls tokens while it goes. The generated code is kept in memory.
+ * Fails if the file does not compile.
+ **/
+_Bool measure_file(const char *, size_t, struct measurement *);
+
+#endif
@@ -0,0 +1,230 @@
+#include "measure.h"
+#include "synth.h"
+#include "../src/common/intern.h"
+#include "../src/common/ast.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <math.h>
+
+#define SCALING_DEFAULT_STEPS 4
+#define SCALING_DEFAULT_ITERATIONS 3
+#define SCALING_DEFAULT_LIMIT 1.3
+
+// A stage needs to take at least this long on the largest input for its growth to be told apart from noise
+#define SCALING_MIN_SECONDS 0.002
+
+/**
+ * One dimension of the synthetic programs. It starts out at 'base' and is doubled with every step,
+ * everything else stays as in 'shape'.
+ **/
+struct axis {
+        const char *name;
+        size_t offset; // Of the dimension in struct synth_shape
+        size_t base;
+        struct synth_shape shape;
+};
+
+// The dimensions that are not scaled. Small, so that the one being scaled dominates the cost
+#define AXIS(name, base) {#name, offsetof(struct synth_shape, name), base, \
+                          {.functions = 100, .depth = 1, .globals = 1, .fields = 3, .params = 1, .expression = 2}}
+
+static struct axis axes[] = {
+        AXIS(functions, 500),
+        AXIS(depth, 16),
+        AXIS(globals, 500),
+        AXIS(fields, 64),
+        AXIS(params, 8),
+        AXIS(expression, 32),
+};
+
+#undef AXIS
+
+#define AXIS_COUNT (sizeof(axes) / sizeof(axes[0]))
+
+static FILE *report;
+
+static void usage(void)
+{
+        fprintf(report, "Usage: polymine_scaling [options]\n"
+                        "  --axis NAME      Only scale this dimension (functions, depth, globals, fields, params, expression)\n"
+                        "  --steps N        Number of times the dimension is doubled (default %d)\n"
+                        "  --iterations N   Compile every program N times, the fastest run counts (default %d)\n"
+                        "  --limit E        Growth exponent above which a stage is flagged as superlinear (default %.1f)\n",
+                SCALING_DEFAULT_STEPS, SCALING_DEFAULT_ITERATIONS, SCALING_DEFAULT_LIMIT);
+}
+
+/**
+ * The exponent k of time ~ size^k: The slope of a least squares line through the measurements on
+ * a log-log scale. 1 is linear growth, 2 quadratic. All measurements have to be positive.
+ **/
+static double growth_exponent(double *sizes, double *seconds, size_t count)
+{
+        double mean_x = 0, mean_y = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                mean_x += log(sizes[i]) / count;
+                mean_y += log(seconds[i]) / count;
+        }
+
+        double covariance = 0, variance = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                double dx = log(sizes[i]) - mean_x;
+                covariance += dx * (log(seconds[i]) - mean_y);
+                variance += dx * dx;
+        }
+
+        return variance > 0 ? covariance / variance : 0;
+}
+
+// Returns the number of stages growing faster than the limit or failing to be fitted, or -1 if a program
+// did not compile
+static int scale_axis(struct axis *axis, size_t steps, size_t iterations, double limit)
+{
+        double sizes[steps];    // The value of the dimension. The rest of the program only makes growth look slower
+        double bytes[steps];
+        double seconds[STAGE_COUNT][steps];
+
+        for (size_t step = 0; step < steps; step++) {
+                struct synth_shape shape = axis->shape;
+                size_t value = axis->base << step;
+                struct measurement m;
+
+                memcpy((char *) &shape + axis->offset, &value, sizeof(value));
+
+                char *path = synth_file(&shape);
+
+                if (!path) {
+                        fprintf(report, "Could not write a synthetic program.\n");
+                        return -1;
+                }
+
+                _Bool compiled = measure_file(path, iterations, &m);
+
+                if (!compiled)
+                        fprintf(report, "The program for %s = %zu (%s) does not compile.\n", axis->name, value, path);
+                else
+                        unlink(path);
+
+                free(path);
+
+                if (!compiled)
+                        return -1;
+
+                sizes[step] = value;
+                bytes[step] = m.bytes;
+
+                for (enum bench_stage stage = 0; stage < STAGE_COUNT; stage++)
+                        seconds[stage][step] = m.seconds[stage];
+        }
+
+        int superlinear = 0;
+
+        for (enum bench_stage stage = 0; stage < STAGE_COUNT; stage++) {
+                fprintf(report, "%-12s %-9s", axis->name, stage_string(stage));
+
+                if (seconds[stage][steps - 1] < SCALING_MIN_SECONDS) {
+                        fprintf(report, "      -  (too fast to tell)\n");
+                        continue;
+                }
+
+                // A smaller program that seemingly took no time at all says nothing about the growth
+                _Bool measured = true;
+
+                for (size_t step = 0; step < steps; step++)
+                        if (!(seconds[stage][step] > 0) || !isfinite(seconds[stage][step]))
+                                measured = false;
+
+                if (!measured) {
+                        fprintf(report, "      -  (a step took no measurable time)\n");
+                        continue;
+                }
+
+                double exponent = growth_exponent(sizes, seconds[stage], steps);
+
+                if (!isfinite(exponent)) {
+                        fprintf(report, "      -  (no growth could be fitted)  FAILED\n");
+                        superlinear++;
+                        continue;
+                }
+
+                fprintf(report, " %6.2f  (%.3f ms at %s = %.0f, %.0f KiB)%s\n", exponent,
+                        seconds[stage][steps - 1] * 1e3, axis->name, sizes[steps - 1], bytes[steps - 1] / 1024,
+                        exponent > limit ? "  SUPERLINEAR" : "");
+
+                if (exponent > limit)
+                        superlinear++;
+        }
+
+        return superlinear;
+}
+
+int main(int argc, char **argv)
+{
+        report = measure_silence();
+
+        size_t steps = SCALING_DEFAULT_STEPS;
+        size_t iterations = SCALING_DEFAULT_ITERATIONS;
+        double limit = SCALING_DEFAULT_LIMIT;
+        const char *only = NULL;
+
+        for (int i = 1; i < argc; i++) {
+                _Bool has_value = i + 1 < argc;
+
+                if (strcmp(argv[i], "--axis") == 0 && has_value)
+                        only = argv[++i];
+                else if (strcmp(argv[i], "--steps") == 0 && has_value)
+                        steps = strtoul(argv[++i], NULL, 10);
+                else if (strcmp(argv[i], "--iterations") == 0 && has_value)
+                        iterations = strtoul(argv[++i], NULL, 10);
+                else if (strcmp(argv[i], "--limit") == 0 && has_value)
+                        limit = strtod(argv[++i], NULL);
+                else {
+                        usage();
+                        return 2;
+                }
+        }
+
+        // Any two points make a line, so that would not tell anything
+        if (steps < 3)
+                steps = 3;
+
+        if (iterations == 0)
+                iterations = 1;
+
+        _Bool known = !only;
+
+        for (size_t i = 0; i < AXIS_COUNT; i++)
+                if (only && strcmp(only, axes[i].name) == 0)
+                        known = true;
+
+        if (!known) {
+                fprintf(report, "There is no axis called \"%s\".\n", only);
+                usage();
+                return 2;
+        }
+
+        intern_init();
+
+        int status = 0;
+
+        fprintf(report, "%-12s %-9s %6s\n", "axis", "stage", "growth");
+
+        for (size_t i = 0; i < AXIS_COUNT; i++) {
+                if (only && strcmp(only, axes[i].name) != 0)
+                        continue;
+
+                if (scale_axis(&axes[i], steps, iterations, limit) != 0)
+                        status = 1;
+        }
+
+        astdtype_free_all();
+        intern_free();
+        fclose(report);
+
+        return status;
+}
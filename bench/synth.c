@@ -0,0 +1,136 @@
+#include "synth.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The arguments of a call to one of the functions. Both the callers and main have 'total' and 'local'
+static void write_arguments(FILE *out, const struct synth_shape *shape)
+{
+        for (size_t i = 0; i < shape->params; i++)
+                fprintf(out, "total, ");
+
+        fprintf(out, "ptr_to[local]");
+}
+
+static void write_function(FILE *out, const struct synth_shape *shape, size_t index)
+{
+        size_t fields = shape->fields ? shape->fields : 1;
+
+        fprintf(out, "fn f%zu(", index);
+
+        for (size_t i = 0; i < shape->params; i++)
+                fprintf(out, "p%zu: int64, ", i);
+
+        fprintf(out, "r: ptr(record)) -> int64 {\n"
+                     "    var local: record\n"
+                     "    var total: int64 = deref[r].f%zu * %zu", index % fields, index + 1);
+
+        for (size_t i = 0; i < shape->params; i++)
+                fprintf(out, " + p%zu", i);
+
+        if (shape->globals > 0)
+                fprintf(out, " + g%zu", index % shape->globals);
+
+        fprintf(out, "\n    var e: int64 = ");
+
+        for (size_t i = 0; i < shape->expression; i++)
+                fprintf(out, "(total + ");
+
+        fprintf(out, "total");
+
+        for (size_t i = 0; i < shape->expression; i++)
+                fprintf(out, ")");
+
+        fprintf(out, "\n    var v0: int64 = e\n");
+
+        // Not indented any further, the source would grow quadratically with the depth otherwise
+        for (size_t i = 1; i <= shape->depth; i++)
+                fprintf(out, "    if v%zu > %zu {\n"
+                             "    var v%zu: int64 = v%zu + total\n", i - 1, i, i, i - 1);
+
+        for (size_t i = 1; i <= shape->depth; i++)
+                fprintf(out, "    }\n");
+
+        if (index > 0) {
+                fprintf(out, "    var next = f%zu(", index - 1);
+                write_arguments(out, shape);
+                fprintf(out, ")\n"
+                             "    resolve total + e + next\n"
+                             "}\n\n");
+        } else
+                fprintf(out, "    resolve total + e\n"
+                             "}\n\n");
+}
+
+void synth_write(FILE *out, const struct synth_shape *shape)
+{
+        size_t fields = shape->fields ? shape->fields : 1;
+
+        fprintf(out, "include \"stdio.h\"\n"
+                     "\n"
+                     "present printf(fmt: string, a: int64) -> void\n"
+                     "\n"
+                     "type record (\n");
+
+        for (size_t i = 0; i < fields; i++)
+                fprintf(out, "    f%zu: int64 default %zu%s\n", i, i + 1, i + 1 < fields ? "," : "");
+
+        fprintf(out, ")\n\n");
+
+        for (size_t i = 0; i < shape->globals; i++)
+                fprintf(out, "var g%zu: int64 = %zu\n", i, i + 1);
+
+        fprintf(out, "\nfn touch(r: ptr(record)) -> void {\n");
+
+        for (size_t i = 0; i < fields; i++)
+                fprintf(out, "    deref[r].f%zu = %zu\n", i, i + 2);
+
+        fprintf(out, "}\n\n");
+
+        for (size_t i = 0; i < shape->functions; i++)
+                write_function(out, shape, i);
+
+        fprintf(out, "fn main -> void {\n"
+                     "    var local: record\n"
+                     "    var total: int64 = 1\n"
+                     "    touch(ptr_to[local])\n");
+
+        if (shape->functions > 0) {
+                fprintf(out, "    printf(\"%%ld\\n\", f%zu(", shape->functions - 1);
+                write_arguments(out, shape);
+                fprintf(out, "))\n");
+        }
+
+        fprintf(out, "}\n");
+}
+
+char *synth_file(const struct synth_shape *shape)
+{
+        char *path = strdup("/tmp/polymine-synth-XXXXXX.poly");
+        int fd = mkstemps(path, strlen(".poly"));
+
+        if (fd < 0) {
+                free(path);
+                return NULL;
+        }
+
+        FILE *out = fdopen(fd, "w");
+
+        if (!out) {
+                close(fd);
+                unlink(path);
+                free(path);
+                return NULL;
+        }
+
+        synth_write(out, shape);
+
+        if (fclose(out) != 0) {
+                unlink(path);
+                free(path);
+                return NULL;
+        }
+
+        return path;
+}
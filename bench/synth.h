@@ -0,0 +1,36 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define SYNTH_DEFAULT_FUNCTIONS 2000
+
+/**
+ * What a synthetic program looks like. Every dimension can be scaled on its own, and the size of the
+ * source grows linearly with each of them.
+ **/
+struct synth_shape {
+        size_t functions;
+        size_t depth;           // Nesting depth of the if blocks in every function
+        size_t globals;         // Global variables. The functions use them round robin
+        size_t fields;          // Fields of the record type, at least one. A function of its own assigns all of them
+        size_t params;          // Parameters of every function, besides the record pointer
+        size_t expression;      // Nesting depth of one parenthesized expression in every function
+};
+
+#ifndef SYNTH_DEFAULT_SHAPE
+#define SYNTH_DEFAULT_SHAPE {.functions = SYNTH_DEFAULT_FUNCTIONS, .depth = 1, .globals = 1, .fields = 3, \
+                             .params = 1, .expression = 2}
+#endif
+
+/**
+ * Write a synthetic program of the given shape. It compiles without errors, and every function
+ * calls the previous one, so none of them can be left out by the compiler.
+ **/
+void synth_write(FILE *, const struct synth_shape *);
+
+// Write a synthetic program to a new temporary file. Returns its path (to be freed), or NULL
+char *synth_file(const struct synth_shape *);
+
+#endif
@@ -0,0 +1,119 @@
+#include "cache.h"
+#include "../common/ast.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+// Distinguishes the temporary files of concurrent stores within one process
+static size_t store_counter = 0;
+
+_Bool cache_open(struct cache *cache, const char *directory)
+{
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+                return false;
+
+        // It might exist without being usable
+        if (access(directory, W_OK | X_OK) != 0)
+                return false;
+
+        cache->directory = strdup(directory);
+        return true;
+}
+
+void cache_close(struct cache *cache)
+{
+        free(cache->directory);
+        cache->directory = NULL;
+}
+
+static void entry_path(struct cache *cache, uint64_t key, char *path, size_t size)
+{
+        snprintf(path, size, "%s/%016" PRIx64 ".c", cache->directory, key);
+}
+
+_Bool cache_load(struct cache *cache, uint64_t key, char **text, size_t *length)
+{
+        char path[strlen(cache->directory) + 32];
+        entry_path(cache, key, path, sizeof(path));
+
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0)
+                return false;
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0) {
+                close(fd);
+                return false;
+        }
+
+        char *buffer = arena_alloc(ast_arena, st.st_size + 1);
+        size_t done = 0;
+
+        while (done < (size_t) st.st_size) {
+                ssize_t n = read(fd, buffer + done, st.st_size - done);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+
+                if (n <= 0)
+                        break;
+
+                done += n;
+        }
+
+        close(fd);
+
+        if (done != (size_t) st.st_size)
+                return false;
+
+        buffer[done] = '\0';
+
+        *text = buffer;
+        *length = done;
+
+        return true;
+}
+
+_Bool cache_store(struct cache *cache, uint64_t key, const char *text, size_t length)
+{
+        char path[strlen(cache->directory) + 32];
+        char temp[sizeof(path) + 64];
+
+        entry_path(cache, key, path, sizeof(path));
+        snprintf(temp, sizeof(temp), "%s.%ld.%zu.tmp", path, (long) getpid(),
+                 __atomic_fetch_add(&store_counter, 1, __ATOMIC_RELAXED));
+
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+                return false;
+
+        size_t done = 0;
+
+        while (done < length) {
+                ssize_t n = write(fd, text + done, length - done);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+
+                if (n <= 0)
+                        break;
+
+                done += n;
+        }
+
+        // Entries only ever appear complete, the same way module outputs do
+        if (close(fd) != 0 || done != length || rename(temp, path) != 0) {
+                unlink(temp);
+                return false;
+        }
+
+        return true;
+}
@@ -0,0 +1,33 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Where --cache keeps the generated code between builds, relative to the working directory. See --cache-dir
+#define CACHE_DIRECTORY ".polymine-cache"
+
+// Part of every key. Has to be changed whenever the compiler generates different code for the same input
+#define CACHE_VERSION "polymine-cache-1"
+
+/**
+ * An on-disk cache for the generated C code of functions. Every entry is a file named after its key, a hash
+ * of everything the code depends on. Entries are never modified, so nothing needs to be invalidated: A function
+ * that changed (or whose dependencies did) simply ends up with a different key.
+ **/
+struct cache {
+        char *directory;
+};
+
+// Creates the directory if needed. Quietly fails if it cannot, the cache is only ever an optimization
+_Bool cache_open(struct cache *, const char *);
+
+void cache_close(struct cache *);
+
+// Read an entry into the AST arena. FALSE if there is none
+_Bool cache_load(struct cache *, uint64_t, char **, size_t *);
+
+// Safe to call from multiple threads and processes at once
+_Bool cache_store(struct cache *, uint64_t, const char *, size_t);
+
+#endif
@@ -0,0 +1,806 @@
+#include "image.h"
+#include "../common/intern.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_MAGIC "POLYAST"
+
+#define IMAGE_ALIGN(n) (((n) + _Alignof(struct astnode) - 1) & ~(size_t) (_Alignof(struct astnode) - 1))
+
+struct image_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t node_size;             // Catches compilers built with a different node layout
+        uint64_t source_hash;
+        uint64_t source_length;
+        uint64_t root;
+        uint64_t data_end;              // Nodes and their arrays start right behind the header
+        uint64_t strings;               // } Offsets of the tables and their numbers of entries
+        uint64_t string_count;          // }
+        uint64_t types;                 // }
+        uint64_t type_count;            // }
+        uint64_t size;
+};
+
+#define DATA_START IMAGE_ALIGN(sizeof(struct image_header))
+
+struct image_type {
+        uint8_t type;
+        uint8_t builtin;
+        uint32_t name;  // String index. Complex types only
+        uint32_t to;    // Index of an earlier type. Pointers only
+};
+
+// In the image, pointers to nodes and arrays hold their offset, strings and data types their index plus one. 0 is NULL
+enum field_kind {
+        FIELD_NODE,
+        FIELD_STRING,
+        FIELD_TYPE,
+        FIELD_REFERENCES,       // The 'reference_count' strings of a function definition
+        FIELD_ABSENT            // Only ever set by semantic analysis
+};
+
+struct field {
+        enum nodetype node;
+        enum field_kind kind;
+        size_t offset;
+};
+
+#define FIELD(node, member, kind) {node, kind, offsetof(struct astnode, member)}
+
+// Every pointer of a node besides 'super', 'holder' and the array of a compound. In the order of the node types
+static const struct field fields[] = {
+        FIELD(NODE_BLOCK, block.nodes, FIELD_NODE),
+        FIELD(NODE_BLOCK, block.symbols, FIELD_NODE),
+        FIELD(NODE_BLOCK, block.table, FIELD_ABSENT),
+        FIELD(NODE_PROGRAM, program.block, FIELD_NODE),
+        FIELD(NODE_STRING_LITERAL, string_literal.value, FIELD_STRING),
+        FIELD(NODE_BINARY_OP, binary.left, FIELD_NODE),
+        FIELD(NODE_BINARY_OP, binary.right, FIELD_NODE),
+        FIELD(NODE_VARIABLE_DECL, declaration.identifier, FIELD_STRING),
+        FIELD(NODE_VARIABLE_DECL, declaration.type, FIELD_TYPE),
+        FIELD(NODE_VARIABLE_DECL, declaration.value, FIELD_NODE),
+        FIELD(NODE_VARIABLE_DECL, declaration.generated_id, FIELD_STRING),
+        FIELD(NODE_VARIABLE_DECL, declaration.refers_to, FIELD_NODE),
+        FIELD(NODE_POINTER, pointer.target, FIELD_NODE),
+        FIELD(NODE_DEREFERENCE, dereference.target, FIELD_NODE),
+        FIELD(NODE_VARIABLE_USE, variable.identifier, FIELD_STRING),
+        FIELD(NODE_VARIABLE_USE, variable.var, FIELD_NODE),
+        FIELD(NODE_VARIABLE_ASSIGNMENT, assignment.path, FIELD_NODE),
+        FIELD(NODE_VARIABLE_ASSIGNMENT, assignment.value, FIELD_NODE),
+        FIELD(NODE_VARIABLE_ASSIGNMENT, assignment.declaration, FIELD_NODE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.identifier, FIELD_STRING),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.params, FIELD_NODE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.type, FIELD_TYPE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.block, FIELD_NODE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.attributes, FIELD_NODE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.generated, FIELD_NODE),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.module, FIELD_STRING),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.references, FIELD_REFERENCES),
+        FIELD(NODE_FUNCTION_DEFINITION, function_def.cached, FIELD_ABSENT),
+        FIELD(NODE_FUNCTION_CALL, function_call.identifier, FIELD_STRING),
+        FIELD(NODE_FUNCTION_CALL, function_call.values, FIELD_NODE),
+        FIELD(NODE_FUNCTION_CALL, function_call.definition, FIELD_NODE),
+        FIELD(NODE_ATTRIBUTE, attribute.identifier, FIELD_STRING),
+        FIELD(NODE_RESOLVE, resolve.value, FIELD_NODE),
+        FIELD(NODE_RESOLVE, resolve.function, FIELD_NODE),
+        FIELD(NODE_DATA_TYPE, data_type.adt, FIELD_TYPE),
+        FIELD(NODE_IF, if_statement.expr, FIELD_NODE),
+        FIELD(NODE_IF, if_statement.block, FIELD_NODE),
+        FIELD(NODE_IF, if_statement.next_branch, FIELD_NODE),
+        FIELD(NODE_COMPLEX_TYPE, type_definition.identifier, FIELD_STRING),
+        FIELD(NODE_COMPLEX_TYPE, type_definition.fields, FIELD_NODE),
+        FIELD(NODE_COMPLEX_TYPE, type_definition.generated_identifier, FIELD_STRING),
+        FIELD(NODE_COMPLEX_TYPE, type_definition.module, FIELD_STRING),
+        FIELD(NODE_PATH, path.expr, FIELD_NODE),
+        FIELD(NODE_PATH, path.next, FIELD_NODE),
+        FIELD(NODE_PATH, path.target, FIELD_NODE),
+        FIELD(NODE_SYMBOL, symbol.identifier, FIELD_STRING),
+        FIELD(NODE_SYMBOL, symbol.type, FIELD_TYPE),
+        FIELD(NODE_SYMBOL, symbol.node, FIELD_NODE),
+        FIELD(NODE_GENERATED_FUNCTION, generated_function.definition, FIELD_NODE),
+        FIELD(NODE_GENERATED_FUNCTION, generated_function.generated_id, FIELD_STRING),
+        FIELD(NODE_INCLUDE, include.path, FIELD_STRING),
+        FIELD(NODE_IMPORT, import.path, FIELD_STRING),
+        FIELD(NODE_IMPORT, import.module, FIELD_STRING),
+        FIELD(NODE_IMPORT, import.base, FIELD_STRING),
+        FIELD(NODE_IMPORT, import.declarations, FIELD_NODE),
+        FIELD(NODE_PRESENT_FUNCTION, present_function.identifier, FIELD_STRING),
+        FIELD(NODE_PRESENT_FUNCTION, present_function.params, FIELD_NODE),
+        FIELD(NODE_PRESENT_FUNCTION, present_function.type, FIELD_TYPE),
+        FIELD(NODE_PRESENT_FUNCTION, present_function.link_name, FIELD_STRING),
+        FIELD(NODE_WRAPPED, wrapped_node.node, FIELD_NODE)
+};
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+#undef FIELD
+
+// Where the fields of each node type start in the table. Those of type t are first[t] up to first[t + 1]
+static void index_fields(size_t *first)
+{
+        memset(first, 0, sizeof(size_t) * (NODETYPE_COUNT + 1));
+
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+                first[fields[i].node + 1]++;
+
+        for (size_t t = 0; t < NODETYPE_COUNT; t++)
+                first[t + 1] += first[t];
+}
+
+static inline struct astnode *field_node(struct astnode *node, const struct field *field)
+{
+        return *(struct astnode **) ((char *) node + field->offset);
+}
+
+char *ast_image_path(const char *directory, uint64_t hash)
+{
+        size_t size = strlen(directory) + strlen(AST_IMAGE_EXTENSION) + 18;
+        char *image = malloc(size);
+
+        if (image)
+                snprintf(image, size, "%s/%016" PRIx64 "%s", directory, hash, AST_IMAGE_EXTENSION);
+
+        return image;
+}
+
+// Space taken by a node in the image, including the arrays stored right behind it
+static size_t node_extent(struct astnode *node)
+{
+        size_t size = IMAGE_ALIGN(astnode_size(node->type));
+
+        if (node->type == NODE_COMPOUND && node->node_compound.count > COMPOUND_INLINE_SLOTS)
+                size += IMAGE_ALIGN(node->node_compound.count * sizeof(struct astnode *));
+
+        if (node->type == NODE_FUNCTION_DEFINITION)
+                size += IMAGE_ALIGN(node->function_def.reference_count * sizeof(char *));
+
+        return size;
+}
+
+// --- Writing
+
+// Open addressing, keyed by address. Only ever grows
+struct pointer_map {
+        const void **keys;
+        uint64_t *values;
+        size_t capacity;
+        size_t count;
+};
+
+static size_t map_hash(const void *key, size_t capacity)
+{
+        return (size_t) (((uintptr_t) key >> 3) * 11400714819323198485ull) & (capacity - 1);
+}
+
+static uint64_t *map_find(struct pointer_map *map, const void *key)
+{
+        if (map->capacity == 0)
+                return NULL;
+
+        for (size_t i = map_hash(key, map->capacity);; i = (i + 1) & (map->capacity - 1)) {
+                if (!map->keys[i])
+                        return NULL;
+
+                if (map->keys[i] == key)
+                        return &map->values[i];
+        }
+}
+
+static void map_put(struct pointer_map *map, const void *key, uint64_t value)
+{
+        if ((map->count + 1) * 2 > map->capacity) {
+                struct pointer_map grown = {.capacity = map->capacity ? map->capacity * 2 : 1024, .count = 0};
+                grown.keys = calloc(grown.capacity, sizeof(void *));
+                grown.values = malloc(grown.capacity * sizeof(uint64_t));
+
+                for (size_t i = 0; i < map->capacity; i++)
+                        if (map->keys[i])
+                                map_put(&grown, map->keys[i], map->values[i]);
+
+                free(map->keys);
+                free(map->values);
+                *map = grown;
+        }
+
+        size_t i = map_hash(key, map->capacity);
+
+        while (map->keys[i])
+                i = (i + 1) & (map->capacity - 1);
+
+        map->keys[i] = key;
+        map->values[i] = value;
+        map->count++;
+}
+
+static void map_free(struct pointer_map *map)
+{
+        free(map->keys);
+        free(map->values);
+}
+
+struct image_buffer {
+        char *data;
+        size_t length;
+        size_t capacity;
+};
+
+// Append zeroed space and return its offset within the buffer
+static size_t buffer_reserve(struct image_buffer *buffer, size_t size)
+{
+        if (buffer->length + size > buffer->capacity) {
+                size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+
+                while (capacity < buffer->length + size)
+                        capacity *= 2;
+
+                buffer->data = realloc(buffer->data, capacity);
+                buffer->capacity = capacity;
+        }
+
+        size_t offset = buffer->length;
+        memset(buffer->data + offset, 0, size);
+        buffer->length += size;
+
+        return offset;
+}
+
+static void buffer_append(struct image_buffer *buffer, const void *data, size_t size)
+{
+        size_t offset = buffer_reserve(buffer, size);
+        memcpy(buffer->data + offset, data, size);
+}
+
+struct image_writer {
+        struct pointer_map nodes;       // Node -> its offset in the image
+        struct pointer_map strings;     // String -> index
+        struct pointer_map types;       // Data type -> index
+        size_t first[NODETYPE_COUNT + 1];
+
+        struct astnode **order;         // In the order they are laid out
+        size_t node_count;
+
+        struct image_buffer data;       // Starting at DATA_START
+        struct image_buffer string_table;
+        struct image_buffer type_table;
+        size_t string_count;
+        size_t type_count;
+
+        _Bool failed;                   // Something was found that cannot be stored
+};
+
+// Assign every node reachable from the root its place in the image. Iterative, trees may be arbitrarily deep
+static void layout(struct image_writer *w, struct astnode *root)
+{
+        size_t stack_capacity = 1024, depth = 0, offset = DATA_START, order_capacity = 1024;
+        struct astnode **stack = malloc(stack_capacity * sizeof(struct astnode *));
+        w->order = malloc(order_capacity * sizeof(struct astnode *));
+
+#define PUSH(n) do { \
+                struct astnode *_n = (n); \
+                if (_n && !map_find(&w->nodes, _n)) { \
+                        if (depth == stack_capacity) \
+                                stack = realloc(stack, (stack_capacity *= 2) * sizeof(struct astnode *)); \
+                        stack[depth++] = _n; \
+                } \
+        } while (0)
+
+        PUSH(root);
+
+        while (depth > 0) {
+                struct astnode *node = stack[--depth];
+
+                if (map_find(&w->nodes, node))
+                        continue;
+
+                map_put(&w->nodes, node, offset);
+                offset += node_extent(node);
+
+                if (w->node_count == order_capacity)
+                        w->order = realloc(w->order, (order_capacity *= 2) * sizeof(struct astnode *));
+
+                w->order[w->node_count++] = node;
+
+                PUSH(node->super);
+                PUSH(node->holder);
+
+                for (size_t i = w->first[node->type]; i < w->first[node->type + 1]; i++)
+                        if (fields[i].kind == FIELD_NODE)
+                                PUSH(field_node(node, &fields[i]));
+
+                if (node->type == NODE_COMPOUND)
+                        for (size_t i = 0; i < node->node_compound.count; i++)
+                                PUSH(node->node_compound.array[i]);
+        }
+
+#undef PUSH
+
+        free(stack);
+        buffer_reserve(&w->data, offset - DATA_START);
+}
+
+// Store an offset or index in place of a pointer, to be patched on load
+static void put(struct image_writer *w, size_t at, uint64_t value)
+{
+        memcpy(w->data.data + (at - DATA_START), &value, sizeof(uint64_t));
+}
+
+static void put_node(struct image_writer *w, size_t at, struct astnode *node)
+{
+        if (node)
+                put(w, at, *map_find(&w->nodes, node));
+}
+
+static uint64_t string_index(struct image_writer *w, const char *string, size_t length)
+{
+        uint64_t *index = map_find(&w->strings, string);
+
+        if (index)
+                return *index;
+
+        uint64_t size = length;
+        buffer_append(&w->string_table, &size, sizeof(uint64_t));
+        buffer_append(&w->string_table, string, length);
+
+        map_put(&w->strings, string, w->string_count);
+        return w->string_count++;
+}
+
+static void put_string(struct image_writer *w, size_t at, const char *string, size_t length)
+{
+        if (string)
+                put(w, at, string_index(w, string, length) + 1);
+}
+
+static uint64_t type_index(struct image_writer *w, struct astdtype *adt)
+{
+        uint64_t *index = map_find(&w->types, adt);
+
+        if (index)
+                return *index;
+
+        struct image_type entry = {.type = adt->type};
+
+        switch (adt->type) {
+                case ASTDTYPE_POINTER:
+                        entry.to = type_index(w, adt->pointer.to);
+                        break;
+                case ASTDTYPE_BUILTIN:
+                        entry.builtin = adt->builtin.datatype;
+                        break;
+                case ASTDTYPE_COMPLEX:
+                        // Resolved types belong to the analysis of a unit
+                        if (adt->complex.definition)
+                                w->failed = true;
+                        entry.name = string_index(w, adt->complex.name, strlen(adt->complex.name));
+                        break;
+                default:
+                        break;
+        }
+
+        buffer_append(&w->type_table, &entry, sizeof(struct image_type));
+
+        map_put(&w->types, adt, w->type_count);
+        return w->type_count++;
+}
+
+static void put_type(struct image_writer *w, size_t at, struct astdtype *adt)
+{
+        if (adt)
+                put(w, at, type_index(w, adt) + 1);
+}
+
+static void write_node(struct image_writer *w, struct astnode *node)
+{
+        size_t offset = *map_find(&w->nodes, node);
+        size_t size = astnode_size(node->type);
+        char *copy = w->data.data + (offset - DATA_START);
+
+        // Every pointer copied along is overwritten below, or cleared if it is NULL
+        memcpy(copy, node, size);
+
+        memset(copy + offsetof(struct astnode, super), 0, sizeof(struct astnode *));
+        memset(copy + offsetof(struct astnode, holder), 0, sizeof(struct astnode *));
+        put_node(w, offset + offsetof(struct astnode, super), node->super);
+        put_node(w, offset + offsetof(struct astnode, holder), node->holder);
+
+        for (size_t i = w->first[node->type]; i < w->first[node->type + 1]; i++) {
+                const struct field *field = &fields[i];
+                void *value = *(void **) ((char *) node + field->offset);
+                size_t at = offset + field->offset;
+
+                memset(copy + field->offset, 0, sizeof(void *));
+
+                if (!value)
+                        continue;
+
+                switch (field->kind) {
+                        case FIELD_NODE:
+                                put_node(w, at, value);
+                                break;
+                        case FIELD_STRING:
+                                put_string(w, at, value, node->type == NODE_STRING_LITERAL
+                                                         ? node->string_literal.length : strlen(value));
+                                break;
+                        case FIELD_TYPE:
+                                put_type(w, at, value);
+                                break;
+                        case FIELD_REFERENCES: {
+                                if (node->function_def.reference_count == 0)
+                                        break;
+
+                                size_t array = offset + IMAGE_ALIGN(size);
+                                put(w, at, array);
+
+                                for (size_t j = 0; j < node->function_def.reference_count; j++) {
+                                        char *reference = node->function_def.references[j];
+                                        put_string(w, array + j * sizeof(char *), reference, strlen(reference));
+                                }
+                                break;
+                        }
+                        case FIELD_ABSENT:
+                                w->failed = true;
+                                break;
+                }
+        }
+
+        if (node->type != NODE_COMPOUND)
+                return;
+
+        // Small compounds go back into their inline slots, larger ones get an array of exactly their size
+        size_t count = node->node_compound.count;
+        size_t slots = offsetof(struct astnode, node_compound.slots);
+        size_t array = (count > COMPOUND_INLINE_SLOTS) ? offset + IMAGE_ALIGN(size) : offset + slots;
+        struct astnode *compound = (struct astnode *) copy;
+
+        memset(copy + slots, 0, sizeof(compound->node_compound.slots));
+        compound->node_compound.array = NULL;
+        compound->node_compound.max_count = (count > COMPOUND_INLINE_SLOTS) ? count : COMPOUND_INLINE_SLOTS;
+
+        put(w, offset + offsetof(struct astnode, node_compound.array), array);
+
+        for (size_t i = 0; i < count; i++)
+                put_node(w, array + i * sizeof(struct astnode *), node->node_compound.array[i]);
+}
+
+static _Bool write_all(int fd, const void *data, size_t length)
+{
+        size_t done = 0;
+
+        while (done < length) {
+                ssize_t n = write(fd, (const char *) data + done, length - done);
+
+                if (n < 0 && errno == EINTR)
+                        continue;
+
+                if (n <= 0)
+                        return false;
+
+                done += n;
+        }
+
+        return true;
+}
+
+static _Bool write_image(const char *path, struct image_writer *w, struct image_header *header)
+{
+        char temp[strlen(path) + 64];
+        snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long) getpid());
+
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+                return false;
+
+        static const char padding[_Alignof(struct astnode)] = {0};
+
+        // Every table starts aligned, see the offsets in the header
+        _Bool success = write_all(fd, header, sizeof(struct image_header)) &&
+                        write_all(fd, padding, DATA_START - sizeof(struct image_header)) &&
+                        write_all(fd, w->data.data, w->data.length) &&
+                        write_all(fd, w->string_table.data, w->string_table.length) &&
+                        write_all(fd, padding, header->types - header->strings - w->string_table.length) &&
+                        write_all(fd, w->type_table.data, w->type_table.length);
+
+        // Images only ever appear complete, the same way cache entries do
+        if (close(fd) != 0 || !success || rename(temp, path) != 0) {
+                unlink(temp);
+                return false;
+        }
+
+        return true;
+}
+
+_Bool ast_image_store(const char *path, struct astnode *root, uint64_t hash, size_t length)
+{
+        struct image_writer w;
+        memset(&w, 0, sizeof(w));
+        index_fields(w.first);
+
+        layout(&w, root);
+
+        for (size_t i = 0; i < w.node_count && !w.failed; i++)
+                write_node(&w, w.order[i]);
+
+        _Bool success = false;
+
+        if (!w.failed) {
+                struct image_header header = {
+                        .magic = IMAGE_MAGIC,
+                        .version = AST_IMAGE_VERSION,
+                        .node_size = sizeof(struct astnode),
+                        .source_hash = hash,
+                        .source_length = length,
+                        .root = *map_find(&w.nodes, root),
+                        .data_end = DATA_START + w.data.length,
+                        .string_count = w.string_count,
+                        .type_count = w.type_count
+                };
+
+                header.strings = header.data_end;
+                header.types = IMAGE_ALIGN(header.strings + w.string_table.length);
+                header.size = header.types + w.type_table.length;
+
+                success = write_image(path, &w, &header);
+        }
+
+        map_free(&w.nodes);
+        map_free(&w.strings);
+        map_free(&w.types);
+        free(w.order);
+        free(w.data.data);
+        free(w.string_table.data);
+        free(w.type_table.data);
+
+        return success;
+}
+
+// --- Loading
+
+struct image_loader {
+        char *base;
+        uint64_t data_end;
+        char **strings;
+        uint64_t string_count;
+        struct astdtype **types;
+        uint64_t type_count;
+};
+
+// Whether 'count' entries of the given size fit into the image at the given offset
+static _Bool in_bounds(struct ast_image *image, uint64_t offset, uint64_t count, uint64_t size)
+{
+        return offset <= image->size && count <= (image->size - offset) / size;
+}
+
+// Turn the offset or index stored in place of a pointer back into the pointer
+static _Bool patch(struct image_loader *l, char *slot, enum field_kind kind)
+{
+        uint64_t value;
+        memcpy(&value, slot, sizeof(uint64_t));
+
+        if (value == 0)
+                return true;
+
+        void *pointer;
+
+        switch (kind) {
+                case FIELD_NODE:
+                case FIELD_REFERENCES:
+                        if (value < DATA_START || value >= l->data_end)
+                                return false;
+                        pointer = l->base + value;
+                        break;
+                case FIELD_STRING:
+                        if (value > l->string_count)
+                                return false;
+                        pointer = l->strings[value - 1];
+                        break;
+                case FIELD_TYPE:
+                        if (value > l->type_count)
+                                return false;
+                        pointer = l->types[value - 1];
+                        break;
+                default:
+                        return false;
+        }
+
+        memcpy(slot, &pointer, sizeof(void *));
+        return true;
+}
+
+// Patch every pointer of the nodes, walking them in the order they are stored
+static _Bool relocate_nodes(struct image_loader *l, const size_t *first)
+{
+        uint64_t offset = DATA_START;
+
+        while (offset < l->data_end) {
+                struct astnode *node = (struct astnode *) (l->base + offset);
+
+                if (l->data_end - offset < IMAGE_ALIGN(sizeof(enum nodetype)) || node->type >= NODETYPE_COUNT ||
+                    l->data_end - offset < astnode_size(node->type))
+                        return false;
+
+                // The counts are checked before anything is derived from them
+                if ((node->type == NODE_COMPOUND && node->node_compound.count > l->data_end / sizeof(void *)) ||
+                    (node->type == NODE_FUNCTION_DEFINITION &&
+                     node->function_def.reference_count > l->data_end / sizeof(void *)))
+                        return false;
+
+                size_t extent = node_extent(node);
+
+                if (extent > l->data_end - offset)
+                        return false;
+
+                if (!patch(l, (char *) &node->super, FIELD_NODE) || !patch(l, (char *) &node->holder, FIELD_NODE))
+                        return false;
+
+                for (size_t i = first[node->type]; i < first[node->type + 1]; i++)
+                        if (!patch(l, (char *) node + fields[i].offset, fields[i].kind))
+                                return false;
+
+                if (node->type == NODE_FUNCTION_DEFINITION && node->function_def.references) {
+                        char *array = (char *) node->function_def.references;
+
+                        if (array + node->function_def.reference_count * sizeof(char *) > l->base + l->data_end)
+                                return false;
+
+                        for (size_t i = 0; i < node->function_def.reference_count; i++)
+                                if (!patch(l, array + i * sizeof(char *), FIELD_STRING))
+                                        return false;
+                }
+
+                if (node->type == NODE_COMPOUND) {
+                        char *array = (char *) node + offsetof(struct astnode, node_compound.array);
+
+                        if (!patch(l, array, FIELD_NODE) || !node->node_compound.array ||
+                            (char *) (node->node_compound.array + node->node_compound.count) > l->base + l->data_end)
+                                return false;
+
+                        for (size_t i = 0; i < node->node_compound.count; i++)
+                                if (!patch(l, (char *) &node->node_compound.array[i], FIELD_NODE))
+                                        return false;
+                }
+
+                offset += extent;
+        }
+
+        return true;
+}
+
+static struct astnode *relocate(struct ast_image *image, uint64_t hash, size_t length)
+{
+        char *base = image->base;
+        struct image_header header;
+
+        memcpy(&header, base, sizeof(struct image_header));
+
+        if (memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != AST_IMAGE_VERSION ||
+            header.node_size != sizeof(struct astnode) || header.source_hash != hash ||
+            header.source_length != length || header.size != image->size)
+                return NULL;
+
+        if (header.data_end < DATA_START || header.data_end > header.strings || header.strings > header.types ||
+            header.root < DATA_START || header.root >= header.data_end ||
+            !in_bounds(image, header.types, header.type_count, sizeof(struct image_type)))
+                return NULL;
+
+        struct image_loader l = {
+                .base = base,
+                .data_end = header.data_end,
+                .strings = malloc(header.string_count * sizeof(char *) + 1),
+                .string_count = header.string_count,
+                .types = malloc(header.type_count * sizeof(struct astdtype *) + 1),
+                .type_count = header.type_count
+        };
+
+        _Bool success = true;
+        size_t cursor = header.strings;
+
+        for (size_t i = 0; i < header.string_count && success; i++) {
+                uint64_t size;
+
+                if (header.types - cursor < sizeof(uint64_t)) {
+                        success = false;
+                        break;
+                }
+
+                memcpy(&size, base + cursor, sizeof(uint64_t));
+                cursor += sizeof(uint64_t);
+
+                if (size > header.types - cursor) {
+                        success = false;
+                        break;
+                }
+
+                l.strings[i] = intern_n(base + cursor, size);
+                cursor += size;
+        }
+
+        for (size_t i = 0; i < header.type_count && success; i++) {
+                struct image_type entry;
+                memcpy(&entry, base + header.types + i * sizeof(struct image_type), sizeof(struct image_type));
+
+                switch (entry.type) {
+                        case ASTDTYPE_VOID:
+                                l.types[i] = astdtype_void();
+                                break;
+                        case ASTDTYPE_BUILTIN:
+                                success = entry.builtin <= BUILTIN_STRING;
+                                if (success)
+                                        l.types[i] = astdtype_builtin(entry.builtin);
+                                break;
+                        case ASTDTYPE_POINTER:
+                                success = entry.to < i;
+                                if (success)
+                                        l.types[i] = astdtype_pointer(l.types[entry.to]);
+                                break;
+                        case ASTDTYPE_COMPLEX:
+                                success = entry.name < header.string_count;
+                                if (success)
+                                        l.types[i] = astdtype_complex(l.strings[entry.name], NULL);
+                                break;
+                        default:
+                                success = false;
+                }
+        }
+
+        size_t first[NODETYPE_COUNT + 1];
+        index_fields(first);
+
+        if (success)
+                success = relocate_nodes(&l, first);
+
+        free(l.strings);
+        free(l.types);
+
+        return success ? (struct astnode *) (base + header.root) : NULL;
+}
+
+struct astnode *ast_image_load(struct ast_image *image, const char *path, uint64_t hash, size_t length)
+{
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0)
+                return NULL;
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) DATA_START) {
+                close(fd);
+                return NULL;
+        }
+
+        // Private and writable: Relocation and later analysis write to the nodes, never to the file.
+        // Every page gets written anyway, faulting them in at once is cheaper
+        void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+
+        if (base == MAP_FAILED)
+                return NULL;
+
+        image->base = base;
+        image->size = st.st_size;
+
+        struct astnode *root = relocate(image, hash, length);
+
+        if (!root)
+                ast_image_close(image);
+
+        return root;
+}
+
+void ast_image_close(struct ast_image *image)
+{
+        if (image->base)
+                munmap(image->base, image->size);
+
+        *image = empty_ast_image;
+}
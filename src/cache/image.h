@@ -0,0 +1,43 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "../common/ast.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Parsed sources are kept in the cache directory (see cache.h), named after the hash of their text
+#define AST_IMAGE_EXTENSION ".polyast"
+
+// Has to be changed whenever the parser builds a different tree for the same input
+#define AST_IMAGE_VERSION 2
+
+/**
+ * The parsed AST of a source file as a flat, relocatable image. Nodes are stored exactly as they are laid out
+ * in memory, with every pointer replaced by an offset into the image (nodes, arrays) or an index into its
+ * tables (strings, data types). Loading maps the file, interns the strings, rebuilds the data types and patches
+ * the pointers in one pass over the nodes. Nothing is lexed or parsed.
+ *
+ * Images are keyed by a hash of the source text, so a source that changed simply gets an image of its own, just
+ * like the functions in the cache. Identical sources at different paths share one. Loaded nodes live in the
+ * private mapping rather than the AST arena, so the image has to stay open as long as the tree is in use.
+ **/
+struct ast_image {
+        void *base;
+        size_t size;
+};
+
+static const struct ast_image empty_ast_image = {.base = NULL, .size = 0};
+
+// Where the image of a source with the given hash is kept in the given cache directory. Has to be freed by the caller
+char *ast_image_path(const char *, uint64_t);
+
+// The tree stored for a source with the given hash and length, or NULL if there is no (matching) image
+struct astnode *ast_image_load(struct ast_image *, const char *, uint64_t, size_t);
+
+// Store a freshly parsed tree. Quietly gives up if the file cannot be written, it is only a cache
+_Bool ast_image_store(const char *, struct astnode *, uint64_t, size_t);
+
+void ast_image_close(struct ast_image *);
+
+#endif
@@ -1,22 +1,40 @@
 
 #include "codegen.h"
+#include "../common/util.h"
+#include "../common/profile.h"
+#include "../semantics/semantics.h"
 
-#define EMIT(...) fprintf(gen->out, __VA_ARGS__)
-#define EMITB(...) EMIT(__VA_ARGS__); break
+#include <pthread.h>
+
+// EMIT only takes string literals. Identifiers and other runtime strings go through EMIT_ID
+#define EMIT(str) emit_literal(gen->out, str)
+#define EMITB(str) EMIT(str); break
+#define EMIT_ID(str) emit_string(gen->out, str)
 
 #define _codegen struct codegen *gen
 
-void codegen_init(struct codegen *codegen, struct astnode *program, struct astnode *stuff, FILE *out)
+void codegen_init(struct codegen *codegen, struct astnode *program, struct astnode *stuff, struct emitter *out)
 {
         codegen->program = program;
         codegen->stuff = stuff;
         codegen->out = out;
         codegen->param_count = 0;
         codegen->param_no = 0;
+        codegen->threads = cpu_count();
+        codegen->module = NULL;
+        codegen->header = NULL;
+        codegen->cache = NULL;
 }
 
 static void *gen_includes(_codegen, struct astnode *node)
 {
+        if (node->type == NODE_IMPORT) {
+                EMIT("#include \"");
+                EMIT_ID(node->import.path);
+                EMIT(".h\"\n");
+                return NULL;
+        }
+
         if (node->type != NODE_INCLUDE)
                 return NULL;
 
@@ -41,13 +59,20 @@ void gen_generate(_codegen)
         // First generate the includes …
         astnode_compound_foreach(gen->stuff, gen, (void *) gen_includes);
 
+        if (gen->module) {
+                EMIT("#include \"");
+                EMIT_ID(gen->header);
+                EMIT("\"\n");
+        }
+
         EMIT("\n");
 
         // … then the bootstrapping code …
-        gen_bootstrap(gen);
+        if (!gen->module)
+                gen_bootstrap(gen);
 
         // … and then, finally, move on to the actual program code
-        gen_any(gen, gen->program);
+        gen_program(gen, gen->program);
 
         printf("Code generation done!\n");
 }
@@ -78,6 +103,7 @@ void gen_any(_codegen, struct astnode *node)
                         gen_variable_declaration(gen, node);
                         break;
                 case NODE_INCLUDE:
+                case NODE_IMPORT:
                         break;
                 case NODE_RESOLVE:
                         gen_resolve(gen, node);
@@ -113,6 +139,186 @@ void gen_any(_codegen, struct astnode *node)
         }
 }
 
+// The output of one top-level node, as a slice of a worker's buffer
+struct gen_slice {
+        struct emitter *source;
+        size_t offset;
+        size_t length;
+};
+
+struct gen_queue {
+        struct astnode **nodes;
+        struct gen_slice *slices;
+        size_t count;
+        size_t next; // Only accessed atomically
+};
+
+struct gen_worker {
+        pthread_t thread;
+        _Bool started;
+        size_t index;
+        struct gen_queue *queue;
+        struct codegen gen;
+        struct emitter out;
+};
+
+// The code of a function either comes from the cache or is stored there for the next build
+static void gen_cached_function(_codegen, struct astnode *fdef)
+{
+        if (fdef->function_def.cached) {
+                emit_raw(gen->out, fdef->function_def.cached, fdef->function_def.cached_length);
+                return;
+        }
+
+        size_t offset = gen->out->length;
+
+        gen_function_definition(gen, fdef);
+
+        if (!gen->out->failed)
+                cache_store(gen->cache, fdef->function_def.cache_key, gen->out->buffer + offset,
+                            gen->out->length - offset);
+}
+
+static void *gen_nodes(struct gen_worker *worker)
+{
+        struct gen_queue *queue = worker->queue;
+        size_t i;
+
+        while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count) {
+                struct gen_slice *slice = &queue->slices[i];
+
+                slice->source = &worker->out;
+                slice->offset = worker->out.length;
+
+                struct astnode *node = queue->nodes[i];
+                double start = profiling ? profile_clock() : 0;
+
+                // Functions go through the cache, if there is one. The header already defines the types of a module
+                if (node->type == NODE_FUNCTION_DEFINITION && worker->gen.cache)
+                        gen_cached_function(&worker->gen, node);
+                else if (!worker->gen.module || node->type != NODE_COMPLEX_TYPE)
+                        gen_any(&worker->gen, node);
+
+                slice->length = worker->out.length - slice->offset;
+
+                if (node->type == NODE_FUNCTION_DEFINITION)
+                        profile_function(FUNCTION_ID(node->function_def.identifier), "generation", worker->index,
+                                         start, node->function_def.cached != NULL);
+        }
+
+        profile_collect();
+
+        return NULL;
+}
+
+/**
+ * Top-level nodes are generated independently of each other on up to gen->threads threads. Their output
+ * is then written in source order, after the prototypes of all functions, so it does not matter to the
+ * C compiler in what order the functions were generated.
+ **/
+void gen_program(_codegen, struct astnode *program)
+{
+        struct astnode *nodes = program->program.block->block.nodes;
+        size_t count = nodes->node_compound.count;
+
+        gen_prototypes(gen, program);
+
+        if (count == 0)
+                return;
+
+        size_t thread_count = gen->threads < count ? gen->threads : count;
+
+        if (thread_count == 0)
+                thread_count = 1;
+
+        struct gen_slice *slices = malloc(count * sizeof(struct gen_slice));
+        struct gen_queue queue = {.nodes = nodes->node_compound.array, .slices = slices, .count = count, .next = 0};
+        struct gen_worker workers[thread_count];
+
+        // The calling thread does its share of the work as the first worker
+        for (size_t i = 0; i < thread_count; i++) {
+                workers[i].queue = &queue;
+                workers[i].index = i;
+                workers[i].gen = *gen;
+                workers[i].gen.out = &workers[i].out;
+                emitter_init_memory(&workers[i].out);
+
+                workers[i].started = i > 0 &&
+                                     pthread_create(&workers[i].thread, NULL, (void *) gen_nodes, &workers[i]) == 0;
+        }
+
+        gen_nodes(&workers[0]);
+
+        for (size_t i = 1; i < thread_count; i++)
+                if (workers[i].started)
+                        pthread_join(workers[i].thread, NULL);
+
+        for (size_t i = 0; i < count; i++)
+                emit_raw(gen->out, slices[i].source->buffer + slices[i].offset, slices[i].length);
+
+        for (size_t i = 0; i < thread_count; i++)
+                emitter_free(&workers[i].out);
+
+        free(slices);
+}
+
+/**
+ * Forward declarations of all global structs and functions. Structs come first, as parameters of
+ * a struct type would otherwise declare a new struct local to the prototype.
+ **/
+void gen_prototypes(_codegen, struct astnode *program)
+{
+        struct astnode *nodes = program->program.block->block.nodes;
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++) {
+                struct astnode *node = nodes->node_compound.array[i];
+
+                if (node->type != NODE_COMPLEX_TYPE)
+                        continue;
+
+                EMIT("struct ");
+                EMIT_ID(node->type_definition.generated_identifier);
+                EMIT(";\n");
+        }
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++) {
+                struct astnode *node = nodes->node_compound.array[i];
+
+                if (node->type != NODE_FUNCTION_DEFINITION)
+                        continue;
+
+                gen_function_signature(gen, node);
+                EMIT(";\n");
+        }
+
+        EMIT("\n");
+}
+
+void gen_header(_codegen)
+{
+        struct astnode *nodes = gen->program->program.block->block.nodes;
+
+        EMIT("#ifndef POLYMINE_MODULE_");
+        EMIT_ID(gen->module);
+        EMIT("_H\n#define POLYMINE_MODULE_");
+        EMIT_ID(gen->module);
+        EMIT("_H\n\n#include <inttypes.h>\n");
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++)
+                if (nodes->node_compound.array[i]->type == NODE_IMPORT)
+                        gen_includes(gen, nodes->node_compound.array[i]);
+
+        EMIT("\n");
+
+        gen_prototypes(gen, gen->program);
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++)
+                if (nodes->node_compound.array[i]->type == NODE_COMPLEX_TYPE)
+                        gen_type_definition(gen, nodes->node_compound.array[i]);
+
+        EMIT("\n#endif\n");
+}
+
 void gen_resolve(_codegen, struct astnode *node)
 {
         EMIT("return ");
@@ -150,7 +356,9 @@ void gen_if(_codegen, struct astnode *node, size_t branch_number)
 
 void gen_include(_codegen, struct astnode *node)
 {
-        EMIT("#include <%s>\n", node->include.path);
+        EMIT("#include <");
+        EMIT_ID(node->include.path);
+        EMIT(">\n");
 }
 
 static void *gen_param(_codegen, struct astnode *_param)
@@ -159,7 +367,8 @@ static void *gen_param(_codegen, struct astnode *_param)
 
         gen_type(gen, param->declaration.type);
 
-        EMIT(" %s", param->declaration.generated_id);
+        EMIT(" ");
+        EMIT_ID(param->declaration.generated_id);
 
         if (gen->param_no + 1 < gen->param_count)
                 EMIT(", ");
@@ -199,7 +408,9 @@ void gen_type(_codegen, struct astdtype *type)
                         gen_type(gen, type->pointer.to);
                         EMITB("*");
                 case ASTDTYPE_COMPLEX:
-                EMITB("struct %s", type->complex.definition->type_definition.generated_identifier);
+                        EMIT("struct ");
+                        EMIT_ID(type->complex.definition->type_definition.generated_identifier);
+                        break;
         }
 }
 
@@ -217,19 +428,38 @@ void gen_path(_codegen, struct astnode *node)
 static void *gen_complex_field(_codegen, struct astnode *field)
 {
         gen_type(gen, field->declaration.type);
-        EMIT(" %s;\n", field->declaration.generated_id);
+        EMIT(" ");
+        EMIT_ID(field->declaration.generated_id);
+        EMIT(";\n");
         return NULL;
 }
 
 void gen_type_definition(_codegen, struct astnode *def)
 {
-        EMIT("struct %s {\n", def->type_definition.generated_identifier);
+        EMIT("struct ");
+        EMIT_ID(def->type_definition.generated_identifier);
+        EMIT(" {\n");
 
         astnode_compound_foreach(def->type_definition.fields, gen, (void *) gen_complex_field);
 
         EMIT("};\n");
 }
 
+void gen_function_signature(_codegen, struct astnode *fdef)
+{
+        gen_type(gen, fdef->function_def.type);
+        EMIT(" ");
+        EMIT_ID(fdef->function_def.generated->generated_function.generated_id);
+        EMIT("(");
+
+        gen->param_count = fdef->function_def.params->node_compound.count;
+        gen->param_no = 0;
+
+        astnode_compound_foreach(fdef->function_def.params, gen, (void *) gen_param);
+
+        EMIT(")");
+}
+
 void gen_function_definition(_codegen, struct astnode *_fdef)
 {
         struct astnode *fdef;
@@ -239,15 +469,9 @@ void gen_function_definition(_codegen, struct astnode *_fdef)
         else
                 fdef = _fdef->generated_function.definition;
 
-        gen_type(gen, fdef->function_def.type);
-        EMIT(" %s(", fdef->function_def.generated->generated_function.generated_id);
-
-        gen->param_count = fdef->function_def.params->node_compound.count;
-        gen->param_no = 0;
-
-        astnode_compound_foreach(fdef->function_def.params, gen, (void *) gen_param);
+        gen_function_signature(gen, fdef);
 
-        EMIT(")\n{\n");
+        EMIT("\n{\n");
         gen_any(gen, fdef->function_def.block);
         EMIT("}\n\n");
 }
@@ -257,7 +481,9 @@ static void *gen_default_initializer(_codegen, struct astnode *field)
         if (!field->declaration.value)
                 return NULL;
 
-        EMIT(".%s = ", field->declaration.generated_id);
+        EMIT(".");
+        EMIT_ID(field->declaration.generated_id);
+        EMIT(" = ");
 
         gen_expression(gen, field->declaration.value);
 
@@ -272,7 +498,8 @@ static void *gen_default_initializer(_codegen, struct astnode *field)
 void gen_variable_declaration(_codegen, struct astnode *decl)
 {
         gen_type(gen, decl->declaration.type);
-        EMIT(" %s", decl->declaration.generated_id);
+        EMIT(" ");
+        EMIT_ID(decl->declaration.generated_id);
         if (decl->declaration.value) {
                 EMIT(" = ");
                 gen_expression(gen, decl->declaration.value);
@@ -330,18 +557,26 @@ void gen_expression(_codegen, struct astnode *expr)
         struct astnode *n;
         switch (expr->type) {
                 case NODE_INTEGER_LITERAL:
-                EMITB("%lld", expr->integer_literal.integerValue);
+                        emit_integer(gen->out, expr->integer_literal.integerValue);
+                        break;
                 case NODE_FLOAT_LITERAL:
-                EMITB("%f", expr->float_literal.floatValue);
+                        emit_format(gen->out, "%f", expr->float_literal.floatValue);
+                        break;
                 case NODE_STRING_LITERAL:
-                EMITB("\"%s\"", expr->string_literal.value);
+                        EMIT("\"");
+                        EMIT_ID(expr->string_literal.value);
+                        EMITB("\"");
                 case NODE_FUNCTION_DEFINITION:
-                EMITB("%s", expr->function_def.generated->generated_function.generated_id);
+                        EMIT_ID(expr->function_def.generated->generated_function.generated_id);
+                        break;
                 case NODE_VARIABLE_USE:
-                EMITB("%s", expr->variable.var->declaration.generated_id);
+                        EMIT_ID(expr->variable.var->declaration.generated_id);
+                        break;
                 case NODE_BINARY_OP:
                         gen_expression(gen, expr->binary.left);
-                        EMIT(" %s ", binaryop_cstr(expr->binary.op));
+                        EMIT(" ");
+                        EMIT_ID(binaryop_cstr(expr->binary.op));
+                        EMIT(" ");
                         gen_expression(gen, expr->binary.right);
                         break;
                 case NODE_FUNCTION_CALL:
@@ -349,9 +584,10 @@ void gen_expression(_codegen, struct astnode *expr)
 
                         char *id = (n->type == NODE_FUNCTION_DEFINITION)
                                    ? expr->function_call.definition->function_def.generated->generated_function.generated_id
-                                   : expr->function_call.identifier;
+                                   : n->present_function.link_name;
 
-                        EMIT("%s(", id);
+                        EMIT_ID(id);
+                        EMIT("(");
 
                         size_t oldParamCount = gen->param_count;
                         size_t oldParamNo = gen->param_no;
@@ -384,6 +620,7 @@ void gen_expression(_codegen, struct astnode *expr)
         }
 }
 
+#undef EMIT_ID
 #undef EMITB
 #undef EMIT
 #undef _codegen
\ No newline at end of file
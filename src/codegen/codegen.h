@@ -4,24 +4,43 @@
 #include <stdio.h>
 
 #include "../common/ast.h"
+#include "emit.h"
+#include "../cache/cache.h"
 
 struct codegen {
         struct astnode *program;
         struct astnode *stuff;
 
-        FILE *out;
+        struct emitter *out;
 
         // Temporary stuff for code generation and keeping track of state
         size_t param_count;
         size_t param_no;
+
+        size_t threads; // Upper limit for the worker threads generating top-level nodes
+
+        // Name and header file of the module being generated, both NULL for a program. Modules have no
+        // bootstrap code and define their exported types in the header only
+        char *module;
+        char *header;
+
+        struct cache *cache; // Functions are reused from here if possible, and stored otherwise. May be NULL
 };
 
-void codegen_init(struct codegen *, struct astnode *, struct astnode *, FILE *);
+void codegen_init(struct codegen *, struct astnode *, struct astnode *, struct emitter *);
 
 void gen_generate(struct codegen *);
 
 void gen_any(struct codegen *, struct astnode *);
 
+void gen_program(struct codegen *, struct astnode *);
+
+void gen_prototypes(struct codegen *, struct astnode *);
+
+void gen_header(struct codegen *);
+
+void gen_function_signature(struct codegen *, struct astnode *);
+
 void gen_resolve(struct codegen *, struct astnode *);
 
 void gen_if(struct codegen *, struct astnode *, size_t);
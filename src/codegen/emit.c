@@ -0,0 +1,204 @@
+#include "emit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+void emitter_init_fd(struct emitter *e, int fd)
+{
+        e->buffer = malloc(EMITTER_BLOCK_SIZE);
+        e->length = 0;
+        e->capacity = EMITTER_BLOCK_SIZE;
+        e->fd = fd;
+        e->failed = false;
+}
+
+void emitter_init_memory(struct emitter *e)
+{
+        emitter_init_fd(e, -1);
+}
+
+// Write all of the given vectors, resuming after short writes
+static _Bool emitter_writev(struct emitter *e, struct iovec *iov, int count)
+{
+        while (count > 0) {
+                ssize_t written = writev(e->fd, iov, count);
+
+                if (written < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        e->failed = true;
+                        return false;
+                }
+
+                while (count > 0 && (size_t) written >= iov->iov_len) {
+                        written -= iov->iov_len;
+                        iov++;
+                        count--;
+                }
+
+                if (count > 0) {
+                        iov->iov_base = (char *) iov->iov_base + written;
+                        iov->iov_len -= written;
+                }
+        }
+
+        return true;
+}
+
+_Bool emitter_flush(struct emitter *e)
+{
+        if (e->fd < 0 || e->length == 0 || e->failed)
+                return !e->failed;
+
+        struct iovec iov = {.iov_base = e->buffer, .iov_len = e->length};
+
+        e->length = 0;
+        return emitter_writev(e, &iov, 1);
+}
+
+// Slow path of emit_raw: The fragment does not fit into what is left of the buffer
+static void emit_overflow(struct emitter *e, const char *str, size_t length)
+{
+        if (e->fd < 0) {
+                while (e->capacity - e->length < length)
+                        e->capacity *= 2;
+
+                e->buffer = realloc(e->buffer, e->capacity);
+                memcpy(e->buffer + e->length, str, length);
+                e->length += length;
+                return;
+        }
+
+        if (e->failed)
+                return;
+
+        // Large fragments go out together with the buffered data, without being copied
+        if (length >= e->capacity / 2) {
+                struct iovec iov[2] = {
+                        {.iov_base = e->buffer, .iov_len = e->length},
+                        {.iov_base = (void *) str, .iov_len = length}
+                };
+
+                e->length = 0;
+                emitter_writev(e, iov, 2);
+                return;
+        }
+
+        emitter_flush(e);
+        memcpy(e->buffer, str, length);
+        e->length = length;
+}
+
+void emit_raw(struct emitter *e, const char *str, size_t length)
+{
+        if (e->capacity - e->length < length) {
+                emit_overflow(e, str, length);
+                return;
+        }
+
+        memcpy(e->buffer + e->length, str, length);
+        e->length += length;
+}
+
+void emit_string(struct emitter *e, const char *str)
+{
+        emit_raw(e, str, strlen(str));
+}
+
+void emit_char(struct emitter *e, char c)
+{
+        if (e->length == e->capacity) {
+                emit_overflow(e, &c, 1);
+                return;
+        }
+
+        e->buffer[e->length++] = c;
+}
+
+void emit_integer(struct emitter *e, long long value)
+{
+        // Digits are produced back to front
+        char digits[24];
+        char *end = digits + sizeof(digits);
+        char *ptr = end;
+
+        unsigned long long magnitude = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+
+        do {
+                *--ptr = (char) ('0' + magnitude % 10);
+                magnitude /= 10;
+        } while (magnitude);
+
+        if (value < 0)
+                *--ptr = '-';
+
+        emit_raw(e, ptr, end - ptr);
+}
+
+void emit_format(struct emitter *e, const char *fmt, ...)
+{
+        va_list args;
+
+        va_start(args, fmt);
+        emit_vformat(e, fmt, args);
+        va_end(args);
+}
+
+void emit_vformat(struct emitter *e, const char *fmt, va_list args)
+{
+        char small[128];
+        va_list again;
+
+        va_copy(again, args);
+        int length = vsnprintf(small, sizeof(small), fmt, args);
+
+        if (length < 0 || (size_t) length < sizeof(small)) {
+                if (length > 0)
+                        emit_raw(e, small, length);
+
+                va_end(again);
+                return;
+        }
+
+        char *large = malloc(length + 1);
+
+        vsnprintf(large, length + 1, fmt, again);
+        va_end(again);
+
+        emit_raw(e, large, length);
+        free(large);
+}
+
+char *emitter_take(struct emitter *e, size_t *length)
+{
+        emit_char(e, '\0');
+
+        char *str = e->buffer;
+
+        if (length)
+                *length = e->length - 1;
+
+        e->buffer = malloc(EMITTER_BLOCK_SIZE);
+        e->capacity = EMITTER_BLOCK_SIZE;
+        e->length = 0;
+
+        return str;
+}
+
+_Bool emitter_free(struct emitter *e)
+{
+        _Bool success = emitter_flush(e);
+
+        free(e->buffer);
+        e->buffer = NULL;
+        e->length = 0;
+        e->capacity = 0;
+
+        return success;
+}
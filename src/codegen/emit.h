@@ -0,0 +1,56 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+// Output is collected in blocks of this size before it is written out
+#define EMITTER_BLOCK_SIZE (64 * 1024)
+
+/**
+ * Output buffer for the code generator. An emitter either writes to a file descriptor,
+ * flushing whenever a block is full, or collects everything in memory (fd == -1).
+ **/
+struct emitter {
+        char *buffer;
+        size_t length;
+        size_t capacity;
+        int fd;
+        _Bool failed; // A write went wrong. Everything after that is dropped
+};
+
+void emitter_init_fd(struct emitter *, int);
+
+void emitter_init_memory(struct emitter *);
+
+void emit_raw(struct emitter *, const char *, size_t);
+
+// Only for string literals: The length is known at compile time
+#define emit_literal(e, str) emit_raw((e), "" str, sizeof(str) - 1)
+
+void emit_string(struct emitter *, const char *);
+
+void emit_char(struct emitter *, char);
+
+void emit_integer(struct emitter *, long long);
+
+void emit_format(struct emitter *, const char *, ...) __attribute__((format(printf, 2, 3)));
+
+void emit_vformat(struct emitter *, const char *, va_list);
+
+_Bool emitter_flush(struct emitter *);
+
+/**
+ * Hand the collected output of an in-memory emitter over to the caller, NUL-terminated.
+ * The emitter is left empty. The caller is responsible for freeing the string.
+ **/
+char *emitter_take(struct emitter *, size_t *);
+
+/**
+ * Flush and release the buffer. The file descriptor is left open.
+ * Returns false if any write failed.
+ **/
+_Bool emitter_free(struct emitter *);
+
+#endif
@@ -0,0 +1,149 @@
+#include "arena.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ALIGN_UP(n) (((n) + (ARENA_ALIGNMENT - 1)) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+void arena_init(struct arena *arena, size_t chunk_size)
+{
+        arena->head = NULL;
+        arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+        arena->allocated = 0;
+}
+
+static struct arena_chunk *arena_new_chunk(struct arena *arena, size_t min_size)
+{
+        size_t size = min_size > arena->chunk_size ? min_size : arena->chunk_size;
+        size_t header = ALIGN_UP(sizeof(struct arena_chunk));
+
+        struct arena_chunk *chunk = malloc(header + size);
+
+        if (!chunk) {
+                printf("Out of memory: Could not allocate an arena chunk of %ld bytes.\n", header + size);
+                exit(1);
+        }
+
+        profile_arena(header + size);
+
+        chunk->data = (char *) chunk + header;
+        chunk->size = size;
+        chunk->used = 0;
+
+        // Oversized chunks are linked in behind the head, so that the remaining space
+        // in the current chunk can still be used by subsequent small allocations
+        if (size > arena->chunk_size && arena->head) {
+                chunk->prev = arena->head->prev;
+                arena->head->prev = chunk;
+                return chunk;
+        }
+
+        chunk->prev = arena->head;
+        arena->head = chunk;
+        return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+        size = ALIGN_UP(size ? size : 1);
+
+        struct arena_chunk *chunk = arena->head;
+
+        if (!chunk || chunk->used + size > chunk->size)
+                chunk = arena_new_chunk(arena, size);
+
+        void *ptr = chunk->data + chunk->used;
+        chunk->used += size;
+        arena->allocated += size;
+
+        return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size)
+{
+        void *ptr = arena_alloc(arena, count * size);
+        memset(ptr, 0, count * size);
+        return ptr;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+        if (!ptr)
+                return arena_alloc(arena, new_size);
+
+        if (new_size <= old_size)
+                return ptr;
+
+        struct arena_chunk *chunk = arena->head;
+        size_t old_aligned = ALIGN_UP(old_size);
+        size_t new_aligned = ALIGN_UP(new_size);
+
+        // Last allocation in the current chunk: Just bump the pointer further
+        if (chunk && (char *) ptr + old_aligned == chunk->data + chunk->used &&
+            chunk->used - old_aligned + new_aligned <= chunk->size) {
+                chunk->used += new_aligned - old_aligned;
+                arena->allocated += new_aligned - old_aligned;
+                return ptr;
+        }
+
+        void *moved = arena_alloc(arena, new_size);
+        memcpy(moved, ptr, old_size);
+        return moved;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t length)
+{
+        char *copy = arena_alloc(arena, length + 1);
+        memcpy(copy, str, length);
+        copy[length] = '\0';
+        return copy;
+}
+
+char *arena_strdup(struct arena *arena, const char *str)
+{
+        return arena_strndup(arena, str, strlen(str));
+}
+
+void arena_adopt(struct arena *arena, struct arena *other)
+{
+        if (!other->head)
+                return;
+
+        arena->allocated += other->allocated;
+
+        if (!arena->head) {
+                arena->head = other->head;
+                goto clear;
+        }
+
+        // Link the adopted chunks in behind the head, just like oversized chunks
+        struct arena_chunk *tail = other->head;
+
+        while (tail->prev)
+                tail = tail->prev;
+
+        tail->prev = arena->head->prev;
+        arena->head->prev = other->head;
+
+        clear:
+        other->head = NULL;
+        other->allocated = 0;
+}
+
+void arena_free(struct arena *arena)
+{
+        struct arena_chunk *chunk = arena->head;
+
+        while (chunk) {
+                struct arena_chunk *prev = chunk->prev;
+                profile_arena(-(ssize_t) (ALIGN_UP(sizeof(struct arena_chunk)) + chunk->size));
+                free(chunk);
+                chunk = prev;
+        }
+
+        arena->head = NULL;
+        arena->allocated = 0;
+}
+
+#undef ALIGN_UP
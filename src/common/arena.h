@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+
+// Size of a regular arena chunk. Allocations larger than this get a chunk of their own.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// Every allocation handed out by the arena is aligned to this boundary
+#define ARENA_ALIGNMENT 16
+
+struct arena_chunk {
+        struct arena_chunk *prev;
+        size_t size;
+        size_t used;
+        char *data;
+};
+
+/**
+ * A bump allocator. Objects allocated from an arena are never freed individually,
+ * they all go away at once when the arena itself is freed.
+ **/
+struct arena {
+        struct arena_chunk *head;
+        size_t chunk_size;
+        size_t allocated; // Bytes handed out to callers
+};
+
+void arena_init(struct arena *, size_t);
+
+void *arena_alloc(struct arena *, size_t);
+
+void *arena_calloc(struct arena *, size_t, size_t);
+
+/**
+ * Grow an allocation. The memory is extended in place if it happens to be the last
+ * allocation of the current chunk, otherwise it is copied and the old space is abandoned
+ **/
+void *arena_realloc(struct arena *, void *, size_t, size_t);
+
+char *arena_strdup(struct arena *, const char *);
+
+char *arena_strndup(struct arena *, const char *, size_t);
+
+/**
+ * Move all chunks of the second arena over to the first one. Used to keep objects allocated by worker
+ * threads alive as long as the main arena. The second arena is left empty.
+ **/
+void arena_adopt(struct arena *, struct arena *);
+
+void arena_free(struct arena *);
+
+#endif
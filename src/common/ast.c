@@ -1,28 +1,40 @@
 #include "ast.h"
-
+#include "intern.h"
+#include "profile.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-_Bool freeDataTypes = false;
+_Thread_local struct arena *ast_arena = NULL;
+_Thread_local size_t astnode_count = 0;
 
-enum builtin_type builtin_from_string(char *str)
+enum builtin_type builtin_from_lxtype(enum lxtype type)
 {
-#define RETURN_IF(val, type) \
-                             if (strcmp(val, str) == 0) \
-                                return type;
-
-        RETURN_IF("char", BUILTIN_CHAR)
-        RETURN_IF("byte", BUILTIN_GENERIC_BYTE)
-        RETURN_IF("double", BUILTIN_DOUBLE)
-        RETURN_IF("int8", BUILTIN_INT8)
-        RETURN_IF("int16", BUILTIN_INT16)
-        RETURN_IF("int32", BUILTIN_INT32)
-        RETURN_IF("int64", BUILTIN_INT64)
-        RETURN_IF("string", BUILTIN_STRING)
-
-#undef RETURN_IF
-
-        return BUILTIN_UNDEFINED;
+        switch (type) {
+                case LX_TYPE_CHAR:
+                        return BUILTIN_CHAR;
+                case LX_TYPE_BYTE:
+                        return BUILTIN_GENERIC_BYTE;
+                case LX_TYPE_DOUBLE:
+                        return BUILTIN_DOUBLE;
+                case LX_TYPE_INT8:
+                        return BUILTIN_INT8;
+                case LX_TYPE_INT16:
+                        return BUILTIN_INT16;
+                case LX_TYPE_INT32:
+                        return BUILTIN_INT32;
+                case LX_TYPE_INT64:
+                        return BUILTIN_INT64;
+                case LX_TYPE_STRING:
+                        return BUILTIN_STRING;
+                default:
+                        return BUILTIN_UNDEFINED;
+        }
 }
 
 const char *builtin_string(enum builtin_type type)
@@ -42,62 +54,175 @@ const char *builtin_string(enum builtin_type type)
 #undef AUTO
 }
 
-void astdtype_free(struct astdtype *adt)
-{
-        switch (adt->type) {
-                case ASTDTYPE_POINTER:
-                        // DON'T!
-//                        astdtype_free(adt->pointer.to);
-                        break;
-                case ASTDTYPE_COMPLEX:
-                        free(adt->complex.name);
-                        break;
-                default:
-                        break;
-        }
+#define BUILTIN(kind) {.type = ASTDTYPE_BUILTIN, .permanent = true, .id = (kind) + 1, \
+                       .builtin = {.datatype = (kind)}}
 
-        free(adt);
-}
+// The permanent types. Named types are found by their (interned) name
+static struct {
+        struct astdtype builtins[ASTDTYPE_BUILTIN_COUNT];
+        struct astdtype _void;
+        uint64_t next_id;
+
+        struct astdtype **named;
+        size_t capacity; // Always a power of two
+        size_t count;
+
+        struct arena arena;
+        pthread_mutex_t lock;
+} types = {
+        .builtins = {BUILTIN(BUILTIN_UNDEFINED), BUILTIN(BUILTIN_CHAR), BUILTIN(BUILTIN_DOUBLE), BUILTIN(BUILTIN_INT8),
+                     BUILTIN(BUILTIN_INT16), BUILTIN(BUILTIN_INT32), BUILTIN(BUILTIN_INT64),
+                     BUILTIN(BUILTIN_GENERIC_BYTE), BUILTIN(BUILTIN_STRING)},
+        ._void = {.type = ASTDTYPE_VOID, .permanent = true, .id = ASTDTYPE_BUILTIN_COUNT + 1},
+        .next_id = ASTDTYPE_BUILTIN_COUNT + 2,
+        .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-struct astdtype *astdtype_generic(enum astdtype_type adtType)
+#undef BUILTIN
+
+// Permanent types are allocated while holding the lock
+static struct astdtype *astdtype_new(enum astdtype_type adtType, _Bool permanent)
 {
-        struct astdtype *adt = malloc(sizeof(struct astdtype));
+        struct astdtype *adt;
+
+        if (permanent) {
+                if (!types.arena.chunk_size)
+                        arena_init(&types.arena, ARENA_CHUNK_SIZE);
+
+                adt = arena_alloc(&types.arena, sizeof(struct astdtype));
+        } else
+                adt = arena_alloc(ast_arena, sizeof(struct astdtype));
+
+        profile_allocated(MEM_DATATYPE, sizeof(struct astdtype));
+
         adt->type = adtType;
+        adt->permanent = permanent;
+        // Saturates rather than wrapping around, so no two types created at any point share an ID below it
+        uint64_t id = __atomic_fetch_add(&types.next_id, 1, __ATOMIC_RELAXED);
+        adt->id = (id < UINT32_MAX) ? id : UINT32_MAX;
+        adt->pointer_type = NULL;
+
         return adt;
 }
 
 struct astdtype *astdtype_pointer(struct astdtype *adt)
 {
-        struct astdtype *wrapper = astdtype_generic(ASTDTYPE_POINTER);
-        wrapper->pointer.to = adt;
-        return wrapper;
+        struct astdtype *pointer = __atomic_load_n(&adt->pointer_type, __ATOMIC_ACQUIRE);
+
+        if (pointer)
+                return pointer;
+
+        if (adt->permanent) {
+                pthread_mutex_lock(&types.lock);
+
+                if (!(pointer = adt->pointer_type)) {
+                        pointer = astdtype_new(ASTDTYPE_POINTER, true);
+                        pointer->pointer.to = adt;
+                        __atomic_store_n(&adt->pointer_type, pointer, __ATOMIC_RELEASE);
+                }
+
+                pthread_mutex_unlock(&types.lock);
+                return pointer;
+        }
+
+        pointer = astdtype_new(ASTDTYPE_POINTER, false);
+        pointer->pointer.to = adt;
+
+        struct astdtype *expected = NULL;
+
+        // Another thread may have been faster. Its pointer type is used then, this one is left over in the arena
+        if (!__atomic_compare_exchange_n(&adt->pointer_type, &expected, pointer, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                return expected;
+
+        return pointer;
 }
 
 struct astdtype *astdtype_builtin(enum builtin_type builtin)
 {
-        struct astdtype *wrapper = astdtype_generic(ASTDTYPE_BUILTIN);
-        wrapper->builtin.datatype = builtin;
-        return wrapper;
+        return &types.builtins[builtin];
 }
 
 struct astdtype *astdtype_void()
 {
-        return astdtype_generic(ASTDTYPE_VOID);
+        return &types._void;
 }
 
 struct astdtype *astdtype_string_type()
 {
-        struct astdtype *wrapper = astdtype_generic(ASTDTYPE_BUILTIN);
-        wrapper->builtin.datatype = BUILTIN_STRING;
-        return wrapper;
+        return &types.builtins[BUILTIN_STRING];
+}
+
+static struct astdtype **named_slot(struct astdtype **named, size_t capacity, char *name)
+{
+        size_t slot = ((uintptr_t) name >> 4) * 0x9E3779B97F4A7C15ull & (capacity - 1);
+
+        while (named[slot] && named[slot]->complex.name != name)
+                slot = (slot + 1) & (capacity - 1);
+
+        return &named[slot];
+}
+
+static void named_grow(void)
+{
+        size_t capacity = types.capacity ? types.capacity * 2 : 64;
+        struct astdtype **named = calloc(capacity, sizeof(struct astdtype *));
+
+        for (size_t i = 0; i < types.capacity; i++)
+                if (types.named[i])
+                        *named_slot(named, capacity, types.named[i]->complex.name) = types.named[i];
+
+        free(types.named);
+        types.named = named;
+        types.capacity = capacity;
 }
 
-struct astdtype *astdtype_complex(char *id)
+struct astdtype *astdtype_complex(char *id, struct astnode *definition)
 {
-        struct astdtype *wrapper = astdtype_generic(ASTDTYPE_COMPLEX);
-        wrapper->complex.name = strdup(id);
-        wrapper->complex.definition = NULL;
-        return wrapper;
+        struct astdtype *complex;
+
+        if (definition) {
+                complex = astdtype_new(ASTDTYPE_COMPLEX, false);
+                complex->complex.name = id;
+                complex->complex.definition = definition;
+                return complex;
+        }
+
+        pthread_mutex_lock(&types.lock);
+
+        // Keep the load factor below 1/2
+        if ((types.count + 1) * 2 > types.capacity)
+                named_grow();
+
+        struct astdtype **slot = named_slot(types.named, types.capacity, id);
+
+        if (!*slot) {
+                complex = astdtype_new(ASTDTYPE_COMPLEX, true);
+                complex->complex.name = id;
+                complex->complex.definition = NULL;
+                *slot = complex;
+                types.count++;
+        }
+
+        complex = *slot;
+
+        pthread_mutex_unlock(&types.lock);
+
+        return complex;
+}
+
+void astdtype_free_all(void)
+{
+        free(types.named);
+        types.named = NULL;
+        types.capacity = types.count = 0;
+
+        if (types.arena.chunk_size)
+                arena_free(&types.arena);
+
+        for (size_t i = 0; i < ASTDTYPE_BUILTIN_COUNT; i++)
+                types.builtins[i].pointer_type = NULL;
+
+        types._void.pointer_type = NULL;
 }
 
 #define MAX_TYPENAME_LENGTH 200
@@ -105,6 +230,7 @@ struct astdtype *astdtype_complex(char *id)
 char *astdtype_string(struct astdtype *type)
 {
         char *typename = calloc(MAX_TYPENAME_LENGTH, sizeof(char));
+        profile_allocated(MEM_TYPE_NAME, MAX_TYPENAME_LENGTH);
 
         if (!type)
                 return typename;
@@ -186,6 +312,7 @@ const char *nodetype_string(enum nodetype type)
                 AUTO(NODE_BINARY_OP)
                 AUTO(NODE_VARIABLE_DECL)
                 AUTO(NODE_POINTER)
+                AUTO(NODE_DEREFERENCE)
                 AUTO(NODE_VARIABLE_USE)
                 AUTO(NODE_VARIABLE_ASSIGNMENT)
                 AUTO(NODE_FUNCTION_DEFINITION)
@@ -194,6 +321,7 @@ const char *nodetype_string(enum nodetype type)
                 AUTO(NODE_RESOLVE)
                 AUTO(NODE_DATA_TYPE)
                 AUTO(NODE_INCLUDE)
+                AUTO(NODE_IMPORT)
                 AUTO(NODE_COMPOUND)
                 AUTO(NODE_GENERATED_FUNCTION)
                 AUTO(NODE_ATTRIBUTE)
@@ -254,6 +382,8 @@ const char *binaryop_string(enum binaryop op)
                 AUTO(BOP_LGREATER)
                 AUTO(BOP_AND)
                 AUTO(BOP_OR)
+                default:
+                        return "Unknown Operator";
         }
 #undef AUTO
 }
@@ -300,104 +430,55 @@ char *symbol_type_humanstr(enum symbol_type type)
         }
 }
 
-void astnode_free(struct astnode *node)
-{
-        if (!node)
-                return;
-
-        switch (node->type) {
-                case NODE_PROGRAM:
-                        astnode_free(node->program.block);
-                        break;
-                case NODE_COMPOUND:
-                        astnode_free_compound(node);
-                        return;
-                case NODE_BLOCK:
-                        astnode_free_block(node);
-                        return;
-                case NODE_STRING_LITERAL:
-                        free(node->string_literal.value);
-                        break;
-                case NODE_BINARY_OP:
-                        astnode_free(node->binary.left);
-                        astnode_free(node->binary.right);
-                        break;
-                case NODE_VARIABLE_DECL:
-                        astnode_free(node->declaration.value);
-                        free(node->declaration.identifier);
-                        if (node->declaration.generated_id)
-                                free(node->declaration.generated_id);
-                        break;
-                case NODE_POINTER:
-                        astnode_free(node->pointer.target);
-                        break;
-                case NODE_DEREFERENCE:
-                        astnode_free(node->dereference.target);
-                        break;
-                case NODE_VARIABLE_USE:
-                        free(node->variable.identifier);
-                        break;
-                case NODE_VARIABLE_ASSIGNMENT:
-                        astnode_free(node->assignment.path);
-                        astnode_free(node->assignment.value);
-                        break;
-                case NODE_FUNCTION_DEFINITION:
-                        if (node->function_def.identifier)
-                                free(node->function_def.identifier);
-                        astnode_free(node->function_def.params);
-                        astnode_free(node->function_def.block);
-                        astnode_free(node->function_def.attributes);
-                        break;
-                case NODE_FUNCTION_CALL:
-                        free(node->function_call.identifier);
-                        astnode_free(node->function_call.values);
-                        break;
-                case NODE_ATTRIBUTE:
-                        free(node->attribute.identifier);
-                        break;
-                case NODE_RESOLVE:
-                        astnode_free(node->resolve.value);
-                        break;
-                case NODE_IF:
-                        astnode_free(node->if_statement.expr);
-                        astnode_free(node->if_statement.block);
-                        astnode_free(node->if_statement.next_branch);
-                        break;
-                case NODE_GENERATED_FUNCTION:
-                        free(node->generated_function.generated_id);
-                        break;
-                case NODE_INCLUDE:
-                        free(node->include.path);
-                        break;
-                case NODE_PRESENT_FUNCTION:
-                        free(node->present_function.identifier);
-                        astnode_free(node->present_function.params);
-                        break;
-                case NODE_DATA_TYPE:
-                        if (!freeDataTypes)
-                                break;
-
-                        astdtype_free(node->data_type.adt);
-                        break;
-                case NODE_COMPLEX_TYPE:
-                        free(node->type_definition.identifier);
-                        free(node->type_definition.generated_identifier);
-                        astnode_free(node->type_definition.fields);
-                        break;
-                case NODE_PATH:
-                        astnode_free(node->path.expr);
-                        if (node->path.next)
-                                astnode_free(node->path.next);
-                default:
-                        break;
-        }
-
-        free(node);
+// The common fields of all nodes, followed by the part of the union a kind of node uses
+#define HEADER offsetof(struct astnode, program)
+#define PAYLOAD(member) (HEADER + sizeof(((struct astnode *) NULL)->member))
+
+static const size_t node_sizes[NODETYPE_COUNT] = {
+        [NODE_UNDEFINED] = HEADER,
+        [NODE_NOTHING] = HEADER,
+        [NODE_COMPOUND] = PAYLOAD(node_compound),
+        [NODE_BLOCK] = PAYLOAD(block),
+        [NODE_PROGRAM] = PAYLOAD(program),
+        [NODE_FLOAT_LITERAL] = PAYLOAD(float_literal),
+        [NODE_INTEGER_LITERAL] = PAYLOAD(integer_literal),
+        [NODE_STRING_LITERAL] = PAYLOAD(string_literal),
+        [NODE_BINARY_OP] = PAYLOAD(binary),
+        [NODE_VARIABLE_DECL] = PAYLOAD(declaration),
+        [NODE_POINTER] = PAYLOAD(pointer),
+        [NODE_DEREFERENCE] = PAYLOAD(dereference),
+        [NODE_VARIABLE_USE] = PAYLOAD(variable),
+        [NODE_VARIABLE_ASSIGNMENT] = PAYLOAD(assignment),
+        [NODE_FUNCTION_DEFINITION] = PAYLOAD(function_def),
+        [NODE_FUNCTION_CALL] = PAYLOAD(function_call),
+        [NODE_ATTRIBUTE] = PAYLOAD(attribute),
+        [NODE_RESOLVE] = PAYLOAD(resolve),
+        [NODE_DATA_TYPE] = PAYLOAD(data_type),
+        [NODE_VOID_PLACEHOLDER] = HEADER,
+        [NODE_IF] = PAYLOAD(if_statement),
+        [NODE_COMPLEX_TYPE] = PAYLOAD(type_definition),
+        [NODE_PATH] = PAYLOAD(path),
+        [NODE_SYMBOL] = PAYLOAD(symbol),
+        [NODE_GENERATED_FUNCTION] = PAYLOAD(generated_function),
+        [NODE_INCLUDE] = PAYLOAD(include),
+        [NODE_IMPORT] = PAYLOAD(import),
+        [NODE_PRESENT_FUNCTION] = PAYLOAD(present_function),
+        [NODE_WRAPPED] = PAYLOAD(wrapped_node)
+};
+
+#undef PAYLOAD
+#undef HEADER
+
+size_t astnode_size(enum nodetype type)
+{
+        return node_sizes[type];
 }
 
 struct astnode *astnode_generic(enum nodetype type, size_t line, struct astnode *block)
 {
-        struct astnode *node = malloc(sizeof(struct astnode));
+        struct astnode *node = arena_alloc(ast_arena, node_sizes[type]);
+        astnode_count++;
+        profile_node(type);
         node->type = type;
         node->line = line;
         node->super = block;
@@ -421,9 +502,9 @@ struct astnode *astnode_empty_compound(size_t line, struct astnode *block)
 {
         struct astnode *node = astnode_generic(NODE_COMPOUND, line, block);
 
-        node->node_compound.max_count = NODE_ARRAY_INCREMENT;
+        node->node_compound.max_count = COMPOUND_INLINE_SLOTS;
         node->node_compound.count = 0;
-        node->node_compound.array = calloc(node->node_compound.max_count, sizeof(struct astnode *));
+        node->node_compound.array = node->node_compound.slots;
 
         return node;
 }
@@ -433,6 +514,7 @@ struct astnode *astnode_empty_block(size_t line, struct astnode *block)
         struct astnode *node = astnode_generic(NODE_BLOCK, line, block);
         node->block.nodes = astnode_empty_compound(line, node);
         node->block.symbols = astnode_empty_compound(line, node);
+        node->block.table = NULL;
         return node;
 }
 
@@ -442,8 +524,19 @@ _Bool astnode_push_compound(struct astnode *compound, struct astnode *node)
 
         // Resize the array if needed
         if (compound->node_compound.count >= compound->node_compound.max_count) {
-                compound->node_compound.array = realloc(compound->node_compound.array, sizeof(struct astnode *) *
-                                                                                       (compound->node_compound.max_count += NODE_ARRAY_INCREMENT));
+                size_t old_size = sizeof(struct astnode *) * compound->node_compound.max_count;
+                compound->node_compound.max_count *= 2;
+                size_t new_size = sizeof(struct astnode *) * compound->node_compound.max_count;
+
+                // The inline slots are part of the node and cannot be grown in place
+                if (compound->node_compound.array == compound->node_compound.slots) {
+                        compound->node_compound.array = arena_alloc(ast_arena, new_size);
+                        memcpy(compound->node_compound.array, compound->node_compound.slots, old_size);
+                } else {
+                        compound->node_compound.array = arena_realloc(ast_arena, compound->node_compound.array, old_size, new_size);
+                }
+
+                profile_allocated(MEM_NODE_ARRAY, new_size);
                 resize = true;
         }
 
@@ -464,23 +557,6 @@ void *astnode_compound_foreach(struct astnode *compound, void *param, void *(*fu
         return NULL;
 }
 
-void astnode_free_compound(struct astnode *compound)
-{
-        for (size_t i = 0; i < compound->node_compound.count; i++) {
-                astnode_free(compound->node_compound.array[i]);
-        }
-
-        free(compound->node_compound.array);
-        free(compound);
-}
-
-void astnode_free_block(struct astnode *block)
-{
-        astnode_free_compound(block->block.nodes);
-        astnode_free_compound(block->block.symbols);
-        free(block);
-}
-
 struct astnode *astnode_float_literal(size_t line, struct astnode *block, double value)
 {
         struct astnode *node = astnode_generic(NODE_FLOAT_LITERAL, line, block);
@@ -498,7 +574,7 @@ struct astnode *astnode_integer_literal(size_t line, struct astnode *block, int6
 struct astnode *astnode_string_literal(size_t line, struct astnode *block, char *value)
 {
         struct astnode *node = astnode_generic(NODE_STRING_LITERAL, line, block);
-        node->string_literal.value = strdup(value);
+        node->string_literal.value = value;
         node->string_literal.length = strlen(value);
         return node;
 }
@@ -518,21 +594,40 @@ struct astnode *astnode_declaration(size_t line, struct astnode *block, _Bool co
         node->declaration.constant = constant;
         node->declaration.type = type;
         node->declaration.value = value;
-        node->declaration.identifier = strdup(str);
+        node->declaration.identifier = str;
         node->declaration.generated_id = NULL;
         node->declaration.number = 0;
         node->declaration.refers_to = NULL;
         return node;
 }
 
-void declaration_generate_name(struct astnode *decl, size_t number)
+// Format a generated identifier into the AST arena
+static char *generate_identifier(const char *format, ...)
+{
+        va_list args;
+
+        va_start(args, format);
+        int length = vsnprintf(NULL, 0, format, args);
+        va_end(args);
+
+        char *id = arena_alloc(ast_arena, length + 1);
+        profile_allocated(MEM_IDENTIFIER, length + 1);
+
+        va_start(args, format);
+        vsnprintf(id, length + 1, format, args);
+        va_end(args);
+
+        return id;
+}
+
+void declaration_generate_name(struct astnode *decl, size_t number, _Bool local)
 {
-        decl->declaration.generated_id = calloc(100, sizeof(char));
         decl->declaration.number = number;
         if (decl->holder && decl->holder->type == NODE_COMPOUND)
-                sprintf(decl->declaration.generated_id, "_param_%s%ld", decl->declaration.identifier, number);
+                decl->declaration.generated_id = generate_identifier("_param_%s%ld", decl->declaration.identifier, number);
         else
-                sprintf(decl->declaration.generated_id, "_var_%s%ld", decl->declaration.identifier, number);
+                decl->declaration.generated_id = generate_identifier(local ? "_local_%s%ld" : "_var_%s%ld",
+                                                                     decl->declaration.identifier, number);
 }
 
 struct astnode *astnode_pointer(size_t line, struct astnode *block, struct astnode *to)
@@ -552,7 +647,7 @@ struct astnode *astnode_dereference(size_t line, struct astnode *block, struct a
 struct astnode *astnode_variable(size_t line, struct astnode *block, char *str)
 {
         struct astnode *node = astnode_generic(NODE_VARIABLE_USE, line, block);
-        node->variable.identifier = strdup(str);
+        node->variable.identifier = str;
         node->variable.var = NULL;
         return node;
 }
@@ -569,7 +664,7 @@ struct astnode *astnode_assignment(size_t line, struct astnode *block, struct as
 struct astnode *astnode_function_definition(size_t line, struct astnode *superblock, char *identifier, struct astnode *parameters, struct astdtype *type, struct astnode *block, struct astnode *attrs)
 {
         struct astnode *node = astnode_generic(NODE_FUNCTION_DEFINITION, line, superblock);
-        node->function_def.identifier = identifier ? strdup(identifier) : NULL;
+        node->function_def.identifier = identifier;
         node->function_def.params = parameters;
         node->function_def.type = type;
         node->function_def.block = block;
@@ -577,30 +672,55 @@ struct astnode *astnode_function_definition(size_t line, struct astnode *superbl
         node->function_def.attributes = attrs;
         node->function_def.generated = NULL;
         node->function_def.param_count = parameters->node_compound.count;
+        node->function_def.module = NULL;
+        node->function_def.digest = 0;
+        node->function_def.references = NULL;
+        node->function_def.reference_count = 0;
+        node->function_def.cache_key = 0;
+        node->function_def.cached = NULL;
+        node->function_def.cached_length = 0;
         return node;
 }
 
 struct astnode *astnode_type_definition(size_t line, struct astnode *super, char *identifier, struct astnode *fields)
 {
         struct astnode *node = astnode_generic(NODE_COMPLEX_TYPE, line, super);
-        node->type_definition.identifier = strdup(identifier);
+        node->type_definition.identifier = identifier;
         node->type_definition.fields = fields;
         node->type_definition.generated_identifier = NULL;
+        node->type_definition.module = NULL;
+        node->type_definition.digest = 0;
         return node;
 }
 
-void complex_type_generate_name(struct astnode *complex, size_t number)
+void complex_type_generate_name(struct astnode *complex, size_t number, _Bool local)
 {
-        complex->type_definition.generated_identifier = calloc(100, sizeof(char));
         complex->type_definition.number = number;
-        sprintf(complex->type_definition.generated_identifier, "_type_%s%ld", complex->type_definition.identifier,
-                number);
+
+        if (!complex->type_definition.module) {
+                complex->type_definition.generated_identifier = generate_identifier(local ? "_local_type_%s%ld"
+                                                                                          : "_type_%s%ld",
+                                                                                    complex->type_definition.identifier,
+                                                                                    number);
+                return;
+        }
+
+        // Exported types are shared with other modules, so neither they nor their fields may be numbered
+        complex->type_definition.generated_identifier = module_symbol_name("type", complex->type_definition.module,
+                                                                           complex->type_definition.identifier);
+
+        struct astnode *fields = complex->type_definition.fields;
+
+        for (size_t i = 0; i < fields->node_compound.count; i++) {
+                struct astnode *field = fields->node_compound.array[i];
+                field->declaration.generated_id = generate_identifier("_field_%s", field->declaration.identifier);
+        }
 }
 
 struct astnode *astnode_function_call(size_t line, struct astnode *block, char *identifier, struct astnode *values)
 {
         struct astnode *node = astnode_generic(NODE_FUNCTION_CALL, line, block);
-        node->function_call.identifier = strdup(identifier);
+        node->function_call.identifier = identifier;
         node->function_call.values = values;
         node->function_call.definition = NULL;
         return node;
@@ -609,7 +729,7 @@ struct astnode *astnode_function_call(size_t line, struct astnode *block, char *
 struct astnode *astnode_attribute(size_t line, struct astnode *block, char *identifier)
 {
         struct astnode *node = astnode_generic(NODE_ATTRIBUTE, line, block);
-        node->attribute.identifier = strdup(identifier);
+        node->attribute.identifier = identifier;
         return node;
 }
 
@@ -673,15 +793,16 @@ struct astnode *astnode_generated_function(struct astnode *definition, size_t nu
         struct astnode *node = astnode_generic(NODE_GENERATED_FUNCTION, 0, NULL);
         node->generated_function.definition = definition;
         node->generated_function.number = number;
-        node->generated_function.generated_id = calloc(100, sizeof(char));
 
         char *id = definition->function_def.identifier;
 
-        if (strcmp(definition->function_def.identifier, "main") == 0) {
+        if (definition->function_def.module) {
+                node->generated_function.generated_id = module_symbol_name("fn", definition->function_def.module, id);
+        } else if (definition->function_def.identifier == NAME(MAIN)) {
                 id = "polymine_bootstrap";
-                sprintf(node->generated_function.generated_id, "_fn_%s", id);
+                node->generated_function.generated_id = generate_identifier("_fn_%s", id);
         } else {
-                sprintf(node->generated_function.generated_id, "_fn_%s%ld", id, number);
+                node->generated_function.generated_id = generate_identifier("_fn_%s%ld", id, number);
         }
 
         return node;
@@ -690,16 +811,32 @@ struct astnode *astnode_generated_function(struct astnode *definition, size_t nu
 struct astnode *astnode_include(size_t line, struct astnode *super, char *path)
 {
         struct astnode *node = astnode_generic(NODE_INCLUDE, line, super);
-        node->include.path = strdup(path);
+        node->include.path = path;
+        return node;
+}
+
+struct astnode *astnode_import(size_t line, struct astnode *super, char *path)
+{
+        struct astnode *node = astnode_generic(NODE_IMPORT, line, super);
+        node->import.path = path;
+        node->import.module = NULL;
+        node->import.base = NULL;
+        node->import.declarations = NULL;
         return node;
 }
 
+char *module_symbol_name(const char *kind, const char *module, const char *identifier)
+{
+        return generate_identifier("_%s_%s_%s", kind, module, identifier);
+}
+
 struct astnode *astnode_present_function(size_t line, struct astnode *super, char *id, struct astnode *params, struct astdtype *type)
 {
         struct astnode *linked = astnode_generic(NODE_PRESENT_FUNCTION, line, super);
         linked->present_function.type = type;
         linked->present_function.params = params;
-        linked->present_function.identifier = strdup(id);
+        linked->present_function.identifier = id;
+        linked->present_function.link_name = id;
         return linked;
 }
 
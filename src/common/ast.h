@@ -2,13 +2,21 @@
 #define AST_H
 
 #include "../syntax/lexer.h"
+#include "arena.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 
-#define NODE_ARRAY_INCREMENT 20
+// Compounds hold this many nodes inside the node itself. Most parameter and argument lists never outgrow them
+#define COMPOUND_INLINE_SLOTS 4
 
-extern _Bool freeDataTypes;
+// All nodes, data types and generated identifiers of the current compilation unit are allocated here.
+// Identifiers taken from the source are interned instead (see intern.h) and compare equal by pointer.
+// Worker threads of the semantic analysis allocate from arenas of their own, hence the thread-local pointer.
+extern _Thread_local struct arena *ast_arena;
+
+// Nodes created by the calling thread so far. For statistics only
+extern _Thread_local size_t astnode_count;
 
 enum nodetype : uint8_t {
         NODE_UNDEFINED = 0,
@@ -40,10 +48,13 @@ enum nodetype : uint8_t {
         NODE_SYMBOL,
         NODE_GENERATED_FUNCTION,
         NODE_INCLUDE,
+        NODE_IMPORT,
         NODE_PRESENT_FUNCTION,
 
         // Memory safety
-        NODE_WRAPPED
+        NODE_WRAPPED,
+
+        NODETYPE_COUNT
 };
 
 const char *nodetype_string(enum nodetype);
@@ -63,7 +74,9 @@ enum binaryop : uint8_t {
         BOP_LGREQ,
 
         BOP_RGREATER,
-        BOP_RGREQ
+        BOP_RGREQ,
+
+        BOP_COUNT
 };
 
 enum binaryop bop_from_lxtype(enum lxtype);
@@ -82,6 +95,12 @@ char *symbol_type_humanstr(enum symbol_type);
 
 struct astdtype;
 
+struct symtable;
+
+/**
+ * Nodes are only as large as the part of the union their type uses (see astnode_size), so a node may
+ * never be accessed through the fields of another type, nor copied as a whole.
+ **/
 struct astnode {
         enum nodetype type;
         size_t line;
@@ -95,12 +114,14 @@ struct astnode {
                 struct {
                         struct astnode *nodes;
                         struct astnode *symbols;
+                        struct symtable *table; // Index over 'symbols'. Managed by semantic analysis
                 } block;
 
                 struct {
-                        struct astnode **array;
+                        struct astnode **array; // Points to 'slots' until they are outgrown, the capacity doubles from then on
                         size_t max_count;
                         size_t count;
+                        struct astnode *slots[COMPOUND_INLINE_SLOTS];
                 } node_compound;
 
                 struct {
@@ -170,6 +191,16 @@ struct astnode {
                         struct astnode *attributes; // Compound
                         struct astnode *generated; // generated_function
                         size_t param_count;
+                        char *module; // Set for functions exported by a module. Managed by semantic analysis
+
+                        // Digest of the tokens of a top-level function and the identifiers it mentions, see parser_record
+                        uint64_t digest;
+                        char **references;
+                        size_t reference_count;
+
+                        uint64_t cache_key;     // } Managed by semantic analysis. If the generated code could be
+                        char *cached;           // } reused from the cache, the body is neither analyzed nor generated
+                        size_t cached_length;   // }
                 } function_def;
 
                 struct {
@@ -198,6 +229,8 @@ struct astnode {
                         struct astnode *fields;         // A compound. Just like function params. Even the same syntax.
                         char *generated_identifier;     // } Managed by semantic analysis
                         size_t number;                  // }
+                        char *module;                   // } Set for types exported by a module
+                        uint64_t digest;                // Of the tokens of a top-level type definition
                 } type_definition;
 
                 // -- Stuff for semantic analysis --
@@ -206,6 +239,7 @@ struct astnode {
                         char *identifier;
                         struct astdtype *type;
                         struct astnode *node;
+                        size_t unit; // Top-level node the symbol was declared by (see semantics_enter_unit)
                 } symbol;
 
                 struct {
@@ -218,10 +252,18 @@ struct astnode {
                         char *path;
                 } include;
 
+                struct {
+                        char *path;                     // As written, relative to the importing file
+                        char *module;                   // } Managed by semantic analysis
+                        char *base;                     // } The module relative to the working directory, see module_base
+                        struct astnode *declarations;   // } The module interface. A compound
+                } import;
+
                 struct {
                         char *identifier;
                         struct astnode *params;
                         struct astdtype *type;
+                        char *link_name; // The C function. The identifier itself, unless imported from a module
                 } present_function;
 
                 // -- Memory safety features --
@@ -243,7 +285,7 @@ enum builtin_type : uint8_t {
         BUILTIN_STRING
 };
 
-enum builtin_type builtin_from_string(char *);
+enum builtin_type builtin_from_lxtype(enum lxtype);
 
 const char *builtin_string(enum builtin_type);
 
@@ -255,10 +297,15 @@ enum astdtype_type : uint8_t {
 };
 
 /**
- * Used to represent (complex) types
+ * Used to represent (complex) types. Builtin, pointer and bare named types are canonical: Structurally equal
+ * ones are one and the same object, so they compare equal by pointer. Complex types carrying their definition
+ * are not, a new one is made in the AST arena every time. No type is modified once created.
  */
 struct astdtype {
         enum astdtype_type type;
+        _Bool permanent;                // Lives as long as the process. See astdtype_pointer
+        uint32_t id;                    // Unique, except that all types past UINT32_MAX share it
+        struct astdtype *pointer_type;  // The type pointing to this one, once there is one
 
         union {
                 struct {
@@ -276,10 +323,14 @@ struct astdtype {
         };
 };
 
-void astdtype_free(struct astdtype *);
-
-struct astdtype *astdtype_generic(enum astdtype_type);
+// Builtin types and void come first, with the lowest IDs
+#define ASTDTYPE_BUILTIN_COUNT (BUILTIN_STRING + 1)
 
+/**
+ * Pointer types are created along with the type they point to. Those to builtin types, void or named
+ * types are permanent, the others belong to the compilation unit of their complex type.
+ * Safe to call from any thread.
+ **/
 struct astdtype *astdtype_pointer(struct astdtype *);
 
 struct astdtype *astdtype_builtin(enum builtin_type);
@@ -288,12 +339,20 @@ struct astdtype *astdtype_void();
 
 struct astdtype *astdtype_string_type();
 
-struct astdtype *astdtype_complex(char *);
+/**
+ * A complex type as named in the source (definition == NULL), which is permanent, or the type introduced by
+ * a definition. The latter is created once per definition, by the semantic analysis, and replaces the names
+ * referring to it (see analyze_type).
+ **/
+struct astdtype *astdtype_complex(char *, struct astnode *);
+
+// Release the permanent types. Nothing may refer to them afterwards
+void astdtype_free_all(void);
 
 char *astdtype_string(struct astdtype *);
 
-/* Free a node recursively */
-void astnode_free(struct astnode *);
+// Bytes allocated for a node of the given type
+size_t astnode_size(enum nodetype);
 
 struct astnode *astnode_generic(enum nodetype, size_t, struct astnode *);
 
@@ -307,10 +366,6 @@ _Bool astnode_push_compound(struct astnode *, struct astnode *);
 
 void *astnode_compound_foreach(struct astnode *, void *, void *(*)(void *, struct astnode *));
 
-void astnode_free_compound(struct astnode *);
-
-void astnode_free_block(struct astnode *);
-
 struct astnode *astnode_empty_block(size_t, struct astnode *);
 
 struct astnode *astnode_float_literal(size_t, struct astnode *, double);
@@ -323,7 +378,8 @@ struct astnode *astnode_binary(size_t, struct astnode *, struct astnode *, struc
 
 struct astnode *astnode_declaration(size_t, struct astnode *, _Bool, char *, struct astdtype *, struct astnode *);
 
-void declaration_generate_name(struct astnode *, size_t);
+// Names local to a function are numbered per function, so they get a prefix of their own to never collide with globals
+void declaration_generate_name(struct astnode *, size_t, _Bool);
 
 struct astnode *astnode_pointer(size_t, struct astnode *, struct astnode *);
 
@@ -337,7 +393,7 @@ struct astnode *astnode_function_definition(size_t, struct astnode *, char *, st
 
 struct astnode *astnode_type_definition(size_t, struct astnode *, char *, struct astnode *);
 
-void complex_type_generate_name(struct astnode *, size_t);
+void complex_type_generate_name(struct astnode *, size_t, _Bool);
 
 struct astnode *astnode_function_call(size_t, struct astnode *, char *, struct astnode *);
 
@@ -363,6 +419,11 @@ struct astnode *astnode_generated_function(struct astnode *, size_t);
 
 struct astnode *astnode_include(size_t, struct astnode *, char *);
 
+struct astnode *astnode_import(size_t, struct astnode *, char *);
+
+// The C name of a symbol exported by a module: _<kind>_<module>_<identifier>
+char *module_symbol_name(const char *, const char *, const char *);
+
 struct astnode *astnode_present_function(size_t, struct astnode *, char *, struct astnode *, struct astdtype *);
 
 // Memory safety --
@@ -0,0 +1,132 @@
+#include "intern.h"
+#include "arena.h"
+#include "profile.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+struct intern_entry {
+        char *string;
+        size_t length;
+        uint32_t hash;
+};
+
+static struct {
+        struct intern_entry *entries;
+        size_t capacity; // Always a power of two
+        size_t count;
+        struct arena strings;
+} table = {.entries = NULL, .capacity = 0, .count = 0};
+
+char *interned_names[NAME_COUNT];
+
+static const char *name_strings[NAME_COUNT] = {
+        [NAME_STABLE] = "stable",
+        [NAME_ELSE] = "else",
+        [NAME_DEFAULT] = "default",
+        [NAME_PTR] = "ptr",
+        [NAME_MAIN] = "main",
+        [NAME_NO_RETURN_CHECKS] = "no_return_checks"
+};
+
+// FNV-1a
+static uint32_t intern_hash(const char *str, size_t length)
+{
+        uint32_t hash = 2166136261u;
+
+        for (size_t i = 0; i < length; i++) {
+                hash ^= (unsigned char) str[i];
+                hash *= 16777619u;
+        }
+
+        return hash;
+}
+
+static void intern_grow(void)
+{
+        size_t capacity = table.capacity ? table.capacity * 2 : INTERN_INITIAL_CAPACITY;
+        struct intern_entry *entries = calloc(capacity, sizeof(struct intern_entry));
+
+        for (size_t i = 0; i < table.capacity; i++) {
+                struct intern_entry *entry = &table.entries[i];
+
+                if (!entry->string)
+                        continue;
+
+                size_t slot = entry->hash & (capacity - 1);
+
+                while (entries[slot].string)
+                        slot = (slot + 1) & (capacity - 1);
+
+                entries[slot] = *entry;
+        }
+
+        free(table.entries);
+        table.entries = entries;
+        table.capacity = capacity;
+}
+
+void intern_init(void)
+{
+        if (table.entries)
+                return;
+
+        arena_init(&table.strings, ARENA_CHUNK_SIZE);
+        intern_grow();
+
+        for (size_t i = 0; i < NAME_COUNT; i++)
+                interned_names[i] = intern(name_strings[i]);
+}
+
+void intern_free(void)
+{
+        free(table.entries);
+        arena_free(&table.strings);
+
+        table.entries = NULL;
+        table.capacity = 0;
+        table.count = 0;
+
+        for (size_t i = 0; i < NAME_COUNT; i++)
+                interned_names[i] = NULL;
+}
+
+char *intern_n(const char *str, size_t length)
+{
+        if (!table.entries)
+                intern_init();
+
+        uint32_t hash = intern_hash(str, length);
+        size_t slot = hash & (table.capacity - 1);
+
+        while (table.entries[slot].string) {
+                struct intern_entry *entry = &table.entries[slot];
+
+                if (entry->hash == hash && entry->length == length && memcmp(entry->string, str, length) == 0)
+                        return entry->string;
+
+                slot = (slot + 1) & (table.capacity - 1);
+        }
+
+        // Keep the load factor below 1/2
+        if ((table.count + 1) * 2 > table.capacity) {
+                intern_grow();
+                return intern_n(str, length);
+        }
+
+        struct intern_entry *entry = &table.entries[slot];
+        entry->string = arena_strndup(&table.strings, str, length);
+        profile_allocated(MEM_TOKEN_STRING, length + 1);
+        entry->length = length;
+        entry->hash = hash;
+        table.count++;
+
+        return entry->string;
+}
+
+char *intern(const char *str)
+{
+        return intern_n(str, strlen(str));
+}
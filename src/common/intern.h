@@ -0,0 +1,40 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdlib.h>
+
+/**
+ * Identifiers, keywords and other token values are interned: Every distinct string is stored
+ * exactly once and handed out as a stable pointer. Two interned strings are equal if and only
+ * if their pointers are equal, so they can be compared with '==' instead of strcmp.
+ * Interned strings must never be modified or freed.
+ **/
+
+// Names the compiler itself has to recognise. These are interned up front by intern_init.
+// Keywords and builtin type names have token types of their own, so only contextual keywords are listed.
+enum interned_name {
+        NAME_STABLE = 0,
+        NAME_ELSE,
+        NAME_DEFAULT,
+        NAME_PTR,
+        NAME_MAIN,
+        NAME_NO_RETURN_CHECKS,
+
+        NAME_COUNT
+};
+
+extern char *interned_names[NAME_COUNT];
+
+#ifndef NAME
+#define NAME(n) (interned_names[NAME_##n])
+#endif
+
+void intern_init(void);
+
+void intern_free(void);
+
+char *intern(const char *);
+
+char *intern_n(const char *, size_t);
+
+#endif
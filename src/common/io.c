@@ -3,42 +3,181 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-_Bool input_read(const char *path, struct input_handle *handle)
+#define READ_CHUNK_SIZE (64 * 1024)
+
+static _Bool input_map(int fd, size_t length, struct input_handle *handle)
 {
-        if (handle->length > 0 || handle->path || handle->buffer) {
-                input_free(handle);
+        int flags = MAP_PRIVATE;
+
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+
+        void *buffer = mmap(NULL, length, PROT_READ, flags, fd, 0);
+
+        if (buffer == MAP_FAILED)
+                return false;
+
+        // The lexer only ever moves forward through the file
+        madvise(buffer, length, MADV_SEQUENTIAL);
+
+        handle->buffer = buffer;
+        handle->length = length;
+        handle->mapped = true;
+
+        return true;
+}
+
+// Fallback for regular files that cannot be mapped. Reads until EOF, so short reads are not a problem
+static _Bool input_read_fd(int fd, struct input_handle *handle)
+{
+        size_t capacity = READ_CHUNK_SIZE;
+        size_t length = 0;
+        char *buffer = malloc(capacity);
+
+        while (true) {
+                if (length == capacity)
+                        buffer = realloc(buffer, capacity *= 2);
+
+                ssize_t count = read(fd, buffer + length, capacity - length);
+
+                if (count < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        free(buffer);
+                        return false;
+                }
+
+                if (count == 0)
+                        break;
+
+                length += count;
         }
 
-        FILE *f = fopen(path, "r");
+        handle->buffer = buffer;
+        handle->length = length;
+        handle->mapped = false;
+
+        return true;
+}
 
-        if (!f) {
+_Bool input_stream(int fd, const char *path, struct input_handle *handle)
+{
+        if (handle->length > 0 || handle->path || handle->buffer)
+                input_free(handle);
+
+        handle->buffer = malloc(STREAM_WINDOW_SIZE);
+        handle->capacity = STREAM_WINDOW_SIZE;
+        handle->length = 0;
+        handle->base = 0;
+        handle->fd = fd;
+        handle->streaming = true;
+        handle->eof = false;
+        handle->mapped = false;
+        handle->path = strdup(path);
+
+        return true;
+}
+
+_Bool input_refill(struct input_handle *handle, size_t keep, size_t *shift)
+{
+        *shift = 0;
+
+        if (!handle->streaming || handle->eof)
                 return false;
+
+        char *buffer = (char *) handle->buffer;
+
+        // Slide the window: Everything before 'keep' has been consumed for good
+        if (keep > 0) {
+                memmove(buffer, buffer + keep, handle->length - keep);
+                handle->length -= keep;
+                handle->base += keep;
+                *shift = keep;
+        }
+
+        // A single token does not fit into the window. Only then does the window grow.
+        if (handle->length == handle->capacity) {
+                buffer = realloc(buffer, handle->capacity *= 2);
+                handle->buffer = buffer;
         }
 
-        fseek(f, 0, SEEK_END);
-        long length = ftell(f);
-        rewind(f);
+        while (true) {
+                ssize_t count = read(handle->fd, buffer + handle->length, handle->capacity - handle->length);
+
+                if (count < 0 && errno == EINTR)
+                        continue;
+
+                if (count <= 0) {
+                        handle->eof = true;
+                        return false;
+                }
+
+                handle->length += count;
+                return true;
+        }
+}
 
-        char *buffer = malloc(sizeof(char) * length);
+static _Bool input_open(const char *path, struct input_handle *handle, _Bool map)
+{
+        if (handle->length > 0 || handle->path || handle->buffer) {
+                input_free(handle);
+        }
+
+        if (strcmp(path, "-") == 0)
+                return input_stream(STDIN_FILENO, path, handle);
+
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0) {
+                return false;
+        }
 
-        fread(buffer, sizeof(char), length, f);
+        struct stat st;
 
-        if (ferror(f) != 0) {
-                free(buffer);
-                fclose(f);
+        if (fstat(fd, &st) != 0) {
+                close(fd);
                 return false;
         }
 
-        fclose(f);
+        if (!S_ISREG(st.st_mode))
+                return input_stream(fd, path, handle);
+
+        _Bool success = false;
+
+        if (map && st.st_size > 0)
+                success = input_map(fd, st.st_size, handle);
+
+        if (!success)
+                success = input_read_fd(fd, handle);
+
+        close(fd);
+
+        if (!success)
+                return false;
 
         handle->path = strdup(path);
-        handle->buffer = buffer;
-        handle->length = length;
 
         return true;
 }
 
+_Bool input_read(const char *path, struct input_handle *handle)
+{
+        return input_open(path, handle, true);
+}
+
+_Bool input_read_copy(const char *path, struct input_handle *handle)
+{
+        return input_open(path, handle, false);
+}
+
 void input_free(struct input_handle *handle)
 {
         if (handle->path) {
@@ -47,10 +186,22 @@ void input_free(struct input_handle *handle)
         }
 
         if (handle->buffer) {
-                free(handle->buffer);
+                if (handle->mapped)
+                        munmap((void *) handle->buffer, handle->length);
+                else
+                        free((void *) handle->buffer);
+
                 handle->buffer = NULL;
         }
 
+        if (handle->streaming && handle->fd > STDERR_FILENO)
+                close(handle->fd);
+
         handle->length = 0;
+        handle->mapped = false;
+        handle->streaming = false;
+        handle->eof = false;
+        handle->fd = -1;
+        handle->base = 0;
+        handle->capacity = 0;
 }
-
@@ -4,19 +4,60 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+// Size of the window a streaming input is read through
+#define STREAM_WINDOW_SIZE (64 * 1024)
+
+/**
+ * A source file, either complete in memory or as a window onto a stream.
+ *
+ * For streaming inputs, 'buffer' holds the bytes from stream offset 'base' up to 'base + length'.
+ * input_refill slides the window forward and reads more. Offsets into the stream are therefore
+ * only resolvable as 'buffer + (offset - base)' while they are still inside the window.
+ * For complete inputs, 'base' is always 0.
+ **/
 static struct input_handle {
         char *path;
-        char *buffer;
+        const char *buffer; // Read-only for consumers. Possibly a memory mapping of the file
         size_t length;
-} empty_input_handle = {.path = NULL, .buffer = NULL, .length = 0};
+        _Bool mapped;
+
+        // Streaming state
+        _Bool streaming;
+        _Bool eof;
+        int fd;
+        size_t base;
+        size_t capacity;
+} empty_input_handle = {.path = NULL, .buffer = NULL, .length = 0, .mapped = false, .streaming = false,
+                        .eof = false, .fd = -1, .base = 0, .capacity = 0};
 
 /**
  * Read the given file into an input_handle object. This will free the previous
  * instance if signs of previous use are detected, i.e. if legnth != 0,
- * path != NULL or buffer != NULL
+ * path != NULL or buffer != NULL.
+ * Regular files are memory-mapped and scanned in place. Pipes, character devices and
+ * the path "-" (standard input) are opened as streams instead.
  **/
 _Bool input_read(const char *, struct input_handle *);
 
+/**
+ * Like input_read, but regular files are read into memory instead of being mapped. For long-lived processes:
+ * A mapped file that is truncated while it is being read (e.g. by an editor saving it) raises SIGBUS.
+ **/
+_Bool input_read_copy(const char *, struct input_handle *);
+
+/**
+ * Set up a streaming input over the given file descriptor. The handle takes ownership
+ * of the descriptor. Nothing is read until the first refill.
+ **/
+_Bool input_stream(int, const char *, struct input_handle *);
+
+/**
+ * Discard the first 'keep' bytes of the window and read more data behind the rest.
+ * The number of discarded bytes is stored in the last parameter, also if nothing new could be read.
+ * Returns false once the stream is exhausted.
+ **/
+_Bool input_refill(struct input_handle *, size_t, size_t *);
+
 void input_free(struct input_handle *);
 
 #endif
@@ -0,0 +1,489 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+_Bool profiling = false;
+_Bool profiling_memory = false;
+_Bool profiling_report = false;
+
+_Thread_local size_t profile_lookups = 0;
+_Thread_local size_t profile_steps = 0;
+
+// One span of the trace. Names are either static or interned
+struct profile_event {
+        char *name;
+        const char *category;
+        size_t thread;
+        double start;
+        double duration;
+        _Bool cached;
+};
+
+struct phase_time {
+        double wall;    // Microseconds
+        double cpu;     // Of all threads of the process
+        long rss;       // Peak resident set size in KiB, as of the end of the phase
+        double started_wall;
+        double started_cpu;
+};
+
+static int trace = -1;
+static pid_t owner = 0;
+
+static const char *unit = NULL;
+static struct phase_time phases[PHASE_COUNT];
+static size_t lookups = 0;
+static size_t steps = 0;
+
+// Objects and bytes per node type and allocation site
+struct allocations {
+        size_t node_count[NODETYPE_COUNT];
+        size_t count[MEM_SITE_COUNT];
+        size_t bytes[MEM_SITE_COUNT];
+};
+
+static _Thread_local struct allocations local_allocations;
+static struct allocations allocations;
+
+// Bytes the arenas hold on to, including what is left unused at the end of chunks
+static size_t arena_bytes = 0;
+static size_t arena_peak = 0;
+
+static struct profile_event *events = NULL;
+static size_t event_count = 0;
+static size_t event_capacity = 0;
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *phase_string(enum phase phase)
+{
+        switch (phase) {
+                case PHASE_READ:
+                        return "reading";
+                case PHASE_LEX:
+                        return "lexing";
+                case PHASE_PARSE:
+                        return "parsing";
+                case PHASE_IMPORTS:
+                        return "imports";
+                case PHASE_ANALYZE:
+                        return "analysis";
+                case PHASE_GENERATE:
+                        return "generation";
+                default:
+                        return "unknown";
+        }
+}
+
+static double clock_us(clockid_t clock)
+{
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+const char *mem_site_string(enum mem_site site)
+{
+        switch (site) {
+                case MEM_DATATYPE:
+                        return "data types";
+                case MEM_TOKEN_STRING:
+                        return "token strings";
+                case MEM_IDENTIFIER:
+                        return "generated identifiers";
+                case MEM_TYPE_NAME:
+                        return "type names";
+                case MEM_NODE_ARRAY:
+                        return "node arrays";
+                case MEM_SYMTABLE:
+                        return "symbol tables";
+                case MEM_REFERENCES:
+                        return "function references";
+                default:
+                        return "unknown";
+        }
+}
+
+double profile_clock(void)
+{
+        return clock_us(CLOCK_MONOTONIC);
+}
+
+_Bool profile_init(_Bool time_report, const char *trace_path)
+{
+        profiling_report = time_report;
+        owner = getpid();
+
+        if (trace_path) {
+                trace = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+                if (trace < 0) {
+                        printf("Could not open the trace file \"%s\".\n", trace_path);
+                        return false;
+                }
+
+                // Events are separated by commas. The last one is written by profile_close, without a comma
+                if (write(trace, "[\n", 2) != 2)
+                        printf("Could not write the trace file \"%s\".\n", trace_path);
+        }
+
+        profiling = profiling_report || trace >= 0;
+
+        return true;
+}
+
+void profile_memory_init(void)
+{
+        owner = getpid();
+        profiling_memory = true;
+}
+
+void profile_close(void)
+{
+        if (trace < 0 || getpid() != owner)
+                return;
+
+        char end[128];
+        int length = snprintf(end, sizeof(end),
+                              "{\"name\": \"process_sort_index\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"sort_index\": 0}}\n]\n",
+                              (int) owner);
+
+        if (write(trace, end, length) != length)
+                printf("Could not finish the trace file.\n");
+
+        close(trace);
+        trace = -1;
+}
+
+void profile_unit(const char *path)
+{
+        if (!profiling && !profiling_memory)
+                return;
+
+        unit = path;
+        memset(&allocations, 0, sizeof(allocations));
+        memset(&local_allocations, 0, sizeof(local_allocations));
+        arena_peak = arena_bytes;
+        memset(phases, 0, sizeof(phases));
+        lookups = steps = 0;
+        profile_lookups = profile_steps = 0;
+        event_count = 0;
+}
+
+static void push_event(char *name, const char *category, size_t thread, double start, double end, _Bool cached)
+{
+        pthread_mutex_lock(&event_lock);
+
+        if (event_count == event_capacity) {
+                event_capacity = event_capacity ? event_capacity * 2 : 256;
+                events = realloc(events, event_capacity * sizeof(struct profile_event));
+        }
+
+        events[event_count++] = (struct profile_event) {name, category, thread, start, end - start, cached};
+
+        pthread_mutex_unlock(&event_lock);
+}
+
+void profile_phase_begin(enum phase phase)
+{
+        if (!profiling)
+                return;
+
+        phases[phase].started_wall = profile_clock();
+        phases[phase].started_cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void profile_phase_end(enum phase phase)
+{
+        if (!profiling)
+                return;
+
+        struct phase_time *time = &phases[phase];
+        struct rusage usage;
+        double end = profile_clock();
+
+        time->wall += end - time->started_wall;
+        time->cpu += clock_us(CLOCK_PROCESS_CPUTIME_ID) - time->started_cpu;
+
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+                time->rss = usage.ru_maxrss;
+
+        push_event((char *) phase_string(phase), "phase", 0, time->started_wall, end, false);
+}
+
+void profile_lexed(double duration)
+{
+        phases[PHASE_LEX].wall += duration;
+}
+
+void profile_function(char *name, const char *category, size_t thread, double start, _Bool cached)
+{
+        if (profiling)
+                push_event(name, category, thread, start, profile_clock(), cached);
+}
+
+void profile_node(enum nodetype type)
+{
+        if (profiling_memory)
+                local_allocations.node_count[type]++;
+}
+
+void profile_allocated(enum mem_site site, size_t bytes)
+{
+        if (!profiling_memory)
+                return;
+
+        local_allocations.count[site]++;
+        local_allocations.bytes[site] += bytes;
+}
+
+void profile_arena(ssize_t bytes)
+{
+        if (!profiling_memory)
+                return;
+
+        size_t held = __atomic_add_fetch(&arena_bytes, bytes, __ATOMIC_RELAXED);
+        size_t peak = __atomic_load_n(&arena_peak, __ATOMIC_RELAXED);
+
+        while (held > peak && !__atomic_compare_exchange_n(&arena_peak, &peak, held, true, __ATOMIC_RELAXED,
+                                                           __ATOMIC_RELAXED));
+}
+
+void profile_collect(void)
+{
+        __atomic_fetch_add(&lookups, profile_lookups, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&steps, profile_steps, __ATOMIC_RELAXED);
+        profile_lookups = profile_steps = 0;
+
+        if (!profiling_memory)
+                return;
+
+        for (size_t i = 0; i < NODETYPE_COUNT; i++)
+                __atomic_fetch_add(&allocations.node_count[i], local_allocations.node_count[i], __ATOMIC_RELAXED);
+
+        for (size_t i = 0; i < MEM_SITE_COUNT; i++) {
+                __atomic_fetch_add(&allocations.count[i], local_allocations.count[i], __ATOMIC_RELAXED);
+                __atomic_fetch_add(&allocations.bytes[i], local_allocations.bytes[i], __ATOMIC_RELAXED);
+        }
+
+        memset(&local_allocations, 0, sizeof(local_allocations));
+}
+
+// Orders the events by name first, so that all spans of a function are next to each other
+static int compare_names(const void *a, const void *b)
+{
+        const struct profile_event *x = a, *y = b;
+
+        if (x->name != y->name)
+                return x->name < y->name ? -1 : 1;
+
+        return 0;
+}
+
+static int compare_durations(const void *a, const void *b)
+{
+        const struct profile_event *x = a, *y = b;
+
+        if (x->duration != y->duration)
+                return x->duration > y->duration ? -1 : 1;
+
+        return 0;
+}
+
+// The time spent analyzing every function, its signature and body combined, the slowest first
+static void report_functions(void)
+{
+        struct profile_event *functions = malloc((event_count ? event_count : 1) * sizeof(struct profile_event));
+        size_t count = 0;
+
+        for (size_t i = 0; i < event_count; i++)
+                if (strcmp(events[i].category, "signature") == 0 || strcmp(events[i].category, "body") == 0)
+                        functions[count++] = events[i];
+
+        qsort(functions, count, sizeof(struct profile_event), compare_names);
+
+        size_t merged = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                if (merged > 0 && functions[merged - 1].name == functions[i].name) {
+                        functions[merged - 1].duration += functions[i].duration;
+                        functions[merged - 1].cached |= functions[i].cached;
+                        continue;
+                }
+
+                functions[merged++] = functions[i];
+        }
+
+        qsort(functions, merged, sizeof(struct profile_event), compare_durations);
+
+        printf("Analysis per function (%ld in total):\n", merged);
+
+        for (size_t i = 0; i < merged && i < PROFILE_FUNCTION_LIMIT; i++)
+                printf("  %10.3f ms  %s%s\n", functions[i].duration / 1e3, functions[i].name,
+                       functions[i].cached ? " (reused from the cache)" : "");
+
+        if (merged > PROFILE_FUNCTION_LIMIT)
+                printf("  ... and %ld more\n", merged - PROFILE_FUNCTION_LIMIT);
+
+        free(functions);
+}
+
+static void print_report(void)
+{
+        printf("-- Time report for \"%s\" --\n", unit);
+        printf("%-12s %12s %12s %14s\n", "phase", "wall ms", "cpu ms", "peak RSS KiB");
+
+        for (enum phase phase = 0; phase < PHASE_COUNT; phase++) {
+                struct phase_time *time = &phases[phase];
+
+                // Lexing is only timed by the wall clock, see profile_lexed. Not at all for streams
+                if (phase == PHASE_LEX) {
+                        if (time->wall > 0)
+                                printf("%-12s %12.3f %12s %14s\n", phase_string(phase), time->wall / 1e3, "-", "-");
+                        else
+                                printf("%-12s %12s %12s %14s\n", phase_string(phase), "-", "-", "-");
+                        continue;
+                }
+
+                printf("%-12s %12.3f %12.3f %14ld\n", phase_string(phase), time->wall / 1e3, time->cpu / 1e3,
+                       time->rss);
+        }
+
+        printf("Lexing was timed in a pass of its own. Parsing includes it.\n");
+        printf("Symbol lookups: %ld, scopes traversed: %ld.\n", lookups, steps);
+
+        report_functions();
+}
+
+struct mem_row {
+        const char *name;
+        size_t count;
+        size_t bytes;
+};
+
+static int compare_bytes(const void *a, const void *b)
+{
+        const struct mem_row *x = a, *y = b;
+
+        if (x->bytes != y->bytes)
+                return x->bytes > y->bytes ? -1 : 1;
+
+        return 0;
+}
+
+// Nodes by type and everything else by site, the largest first
+static void print_memory_report(void)
+{
+        struct mem_row rows[NODETYPE_COUNT + MEM_SITE_COUNT];
+        size_t count = 0, nodes = 0, total = 0;
+
+        for (enum nodetype type = 0; type < NODETYPE_COUNT; type++) {
+                if (allocations.node_count[type] == 0)
+                        continue;
+
+                rows[count++] = (struct mem_row) {nodetype_string(type), allocations.node_count[type],
+                                                  allocations.node_count[type] * astnode_size(type)};
+                nodes += allocations.node_count[type];
+        }
+
+        for (enum mem_site site = 0; site < MEM_SITE_COUNT; site++)
+                if (allocations.count[site] > 0)
+                        rows[count++] = (struct mem_row) {mem_site_string(site), allocations.count[site],
+                                                          allocations.bytes[site]};
+
+        qsort(rows, count, sizeof(struct mem_row), compare_bytes);
+
+        printf("-- Memory report for \"%s\" --\n", unit);
+        printf("%-24s %12s %14s\n", "allocated for", "count", "KiB");
+
+        for (size_t i = 0; i < count; i++) {
+                printf("%-24s %12ld %14.1f\n", rows[i].name, rows[i].count, rows[i].bytes / 1024.0);
+                total += rows[i].bytes;
+        }
+
+        printf("Nodes: %ld, of up to %ld bytes each. Total: %.1f KiB.\n", nodes, sizeof(struct astnode),
+               total / 1024.0);
+
+        struct rusage usage;
+        long rss = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+        printf("Peak heap held by arenas: %.1f KiB, peak RSS: %ld KiB.\n", arena_peak / 1024.0, rss);
+}
+
+// Escapes what may appear in paths and identifiers
+static void write_string(FILE *out, const char *str)
+{
+        fputc('"', out);
+
+        for (; *str; str++) {
+                if (*str == '"' || *str == '\\')
+                        fputc('\\', out);
+
+                if ((unsigned char) *str < 0x20)
+                        fprintf(out, "\\u%04x", *str);
+                else
+                        fputc(*str, out);
+        }
+
+        fputc('"', out);
+}
+
+// All events of the unit go into the trace with a single write, so processes never interleave them
+static void write_trace(void)
+{
+        char *buffer = NULL;
+        size_t length = 0;
+        FILE *out = open_memstream(&buffer, &length);
+        int pid = getpid();
+
+        if (!out)
+                return;
+
+        fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": ", pid);
+        write_string(out, unit);
+        fprintf(out, "}},\n");
+
+        for (size_t i = 0; i < event_count; i++) {
+                struct profile_event *event = &events[i];
+
+                fprintf(out, "{\"name\": ");
+                write_string(out, event->name);
+                fprintf(out, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %ld",
+                        event->category, event->start, event->duration, pid, event->thread);
+
+                if (event->cached)
+                        fprintf(out, ", \"args\": {\"cached\": true}");
+
+                fprintf(out, "},\n");
+        }
+
+        fclose(out);
+
+        if (write(trace, buffer, length) != (ssize_t) length)
+                printf("Could not write the trace file.\n");
+
+        free(buffer);
+}
+
+void profile_finish(void)
+{
+        if (!profiling && !profiling_memory)
+                return;
+
+        profile_collect();
+
+        if (profiling_report)
+                print_report();
+
+        if (profiling_memory)
+                print_memory_report();
+
+        if (trace >= 0)
+                write_trace();
+}
@@ -0,0 +1,100 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "ast.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// The functions taking the longest to analyze that --time-report lists
+#define PROFILE_FUNCTION_LIMIT 20
+
+enum phase {
+        PHASE_READ = 0,
+        PHASE_LEX,      // Happens during parsing, as the parser pulls tokens. Timed in a pass of its own
+        PHASE_PARSE,
+        PHASE_IMPORTS,  // Waiting for imported modules to be compiled
+        PHASE_ANALYZE,
+        PHASE_GENERATE,
+
+        PHASE_COUNT
+};
+
+const char *phase_string(enum phase);
+
+// Set if either a time report or a trace was asked for. Nothing below records anything otherwise
+extern _Bool profiling;
+
+// Set if a time report was asked for
+extern _Bool profiling_report;
+
+// Set if a memory report was asked for. The allocations below are only counted then
+extern _Bool profiling_memory;
+
+// What memory goes to, besides the nodes themselves. Those are counted per node type
+enum mem_site {
+        MEM_DATATYPE = 0,
+        MEM_TOKEN_STRING,       // Interned text of tokens and other identifiers
+        MEM_IDENTIFIER,         // Identifiers generated for the C code
+        MEM_TYPE_NAME,          // Data types spelled out by astdtype_string
+        MEM_NODE_ARRAY,         // Arrays of compounds, including the ones outgrown
+        MEM_SYMTABLE,
+        MEM_REFERENCES,         // Identifiers mentioned by each function, for the cache keys
+
+        MEM_SITE_COUNT
+};
+
+const char *mem_site_string(enum mem_site);
+
+// Symbol lookups and scopes visited by the calling thread, see profile_collect
+extern _Thread_local size_t profile_lookups;
+extern _Thread_local size_t profile_steps;
+
+/**
+ * Enable the time report and/or Chrome trace events written to the given path (NULL for none).
+ * Modules compiled in processes of their own report on their own and add their events to the same trace.
+ **/
+_Bool profile_init(_Bool, const char *);
+
+// Enable the memory report, printed alongside the time report by profile_finish
+void profile_memory_init(void);
+
+// Write the end of the trace. Only the process that called profile_init does
+void profile_close(void);
+
+// Microseconds on a clock shared by all processes
+double profile_clock(void);
+
+// Start profiling the compilation of a file. Everything recorded by the process so far is discarded
+void profile_unit(const char *);
+
+void profile_phase_begin(enum phase);
+
+void profile_phase_end(enum phase);
+
+// Time a separate pass over the whole input took to lex it. Timing every token would mostly time the clock
+void profile_lexed(double);
+
+/**
+ * One span of work on a function. The category tells apart the signature, the body and code generation.
+ * The thread is the index of the worker, 0 for the calling thread. Safe to call from any thread.
+ **/
+void profile_function(char *, const char *, size_t, double, _Bool);
+
+// A node was created by the calling thread
+void profile_node(enum nodetype);
+
+// Bytes allocated by the calling thread for one object
+void profile_allocated(enum mem_site, size_t);
+
+// Bytes taken from (positive) or given back to (negative) the heap by the arenas
+void profile_arena(ssize_t);
+
+// Add the counters of the calling thread to the totals. Worker threads call this before they exit
+void profile_collect(void);
+
+// Print the time and memory reports and write the trace events of the current unit
+void profile_finish(void);
+
+#endif
@@ -6,6 +6,7 @@
 #include "../semantics/semantics.h"
 
 #include <string.h>
+#include <unistd.h>
 #include <math.h>
 
 int char_to_digit(char c)
@@ -13,9 +14,8 @@ int char_to_digit(char c)
         return c - '0';
 }
 
-double string_to_float(char *str)
+double string_to_float(const char *str, size_t len)
 {
-        size_t len = strlen(str);
         double output = 0.0;
 
         size_t dIdx = 0; // Decimal index
@@ -39,9 +39,8 @@ double string_to_float(char *str)
         return output;
 }
 
-int64_t string_to_integer(char *str)
+int64_t string_to_integer(const char *str, size_t len)
 {
-        size_t len = strlen(str);
         int64_t output = 0;
 
         for (size_t i = 0; i < len; i++)
@@ -50,6 +49,24 @@ int64_t string_to_integer(char *str)
         return output;
 }
 
+size_t cpu_count(void)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        return cpus > 0 ? cpus : 1;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+        const unsigned char *bytes = data;
+
+        for (size_t i = 0; i < length; i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+        }
+
+        return hash;
+}
+
 void ast_print(struct astnode *_node, size_t level)
 {
         struct astnode *node = UNWRAP(_node);
@@ -168,7 +185,13 @@ void ast_print(struct astnode *_node, size_t level)
                                  s);
                         free(s);
                         ast_print(node->function_def.params, level + 1);
-                        ast_print(node->function_def.block, level + 1);
+
+                        // The body of a reused function was never analyzed
+                        if (node->function_def.cached) {
+                                INDENTED("\t(Reused from the cache)\n");
+                        } else
+                                ast_print(node->function_def.block, level + 1);
+
                         ast_print(node->function_def.attributes, level + 1);
                         break;
 
@@ -202,6 +225,10 @@ void ast_print(struct astnode *_node, size_t level)
                 INDENTED("Include \"%s\"\n", node->include.path);
                         break;
 
+                case NODE_IMPORT:
+                INDENTED("Import \"%s\"\n", node->import.path);
+                        break;
+
                 case NODE_SYMBOL:
                 INDENTED("Symbol (%s)\n", node->symbol.identifier);
                         break;
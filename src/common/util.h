@@ -9,12 +9,21 @@
 
 int char_to_digit(char c);
 
-double string_to_float(char *);
+double string_to_float(const char *, size_t);
 
-int64_t string_to_integer(char *);
+int64_t string_to_integer(const char *, size_t);
 
 char *repeat(char, size_t);
 
+// Number of online CPUs, at least 1. Upper limit for the worker threads of the compiler
+size_t cpu_count(void);
+
+// Initial value for hash_bytes
+#define HASH_SEED 14695981039346656037ull
+
+// Fold bytes into a running 64 bit FNV-1a hash. Not suitable for anything security related
+uint64_t hash_bytes(uint64_t, const void *, size_t);
+
 void ast_print(struct astnode *, size_t);
 
 #endif
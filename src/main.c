@@ -4,9 +4,22 @@
 #include "syntax/syntax.h"
 #include "semantics/semutil.h"
 #include "common/util.h"
+#include "common/intern.h"
 #include "codegen/codegen.h"
+#include "modules/module.h"
+#include "cache/cache.h"
+#include "cache/image.h"
+#include "server/server.h"
+#include "common/profile.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 void print_license()
 {
@@ -16,62 +29,496 @@ void print_license()
                "under the terms of the GNU GPL license\n\n");
 }
 
-int main(void)
+// Generated code of functions is reused across builds. NULL unless asked for and the directory is usable
+static struct cache *cache = NULL;
+
+// Where the program is written when compiling on behalf of a server or to standard output. output_path otherwise
+static int program_output = -1;
+
+// The generated program, or what the C compiler makes of it
+static const char *output_path = NULL;
+
+/**
+ * The C compiler the generated program is piped into, NULL to write it out instead. It is started as soon as
+ * code generation begins and compiles while we generate. The sources of imported modules are compiled along
+ * with it, unless only an object file is wanted. Extra arguments are passed on as they are.
+ **/
+static const char *c_compiler = NULL;
+static _Bool object_only = false;
+static char **c_arguments = NULL;
+static int c_argument_count = 0;
+
+// Writes the generated C code of a module, along with its header and interface summary
+static _Bool generate_module(struct astnode *program, struct semantics *sem, const char *path, char *module)
 {
-//        print_license();
+        size_t length = strlen(path);
+        size_t extension = strlen(MODULE_SOURCE_EXTENSION);
 
-        struct input_handle handle = empty_input_handle;
-        if (!input_read("input.poly", &handle)) {
-                printf("Could not load input file.\n");
-                return 0;
+        if (length > extension && strcmp(path + length - extension, MODULE_SOURCE_EXTENSION) == 0)
+                length -= extension;
+
+        char base[length + 8];
+        char *header = strrchr(path, '/') ? strrchr(path, '/') + 1 : (char *) path;
+        size_t header_length = length - (header - path);
+        char header_name[header_length + 3];
+
+        snprintf(header_name, sizeof(header_name), "%.*s.h", (int) header_length, header);
+
+        struct module_output source, definitions;
+        struct emitter out;
+        struct codegen gen;
+
+        snprintf(base, sizeof(base), "%.*s.c", (int) length, path);
+
+        if (!module_output_open(&source, base))
+                return false;
+
+        emitter_init_fd(&out, source.fd);
+        codegen_init(&gen, program, sem->stuff, &out);
+        gen.cache = sem->cache;
+        gen.module = module;
+        gen.header = header_name;
+        gen_generate(&gen);
+
+        if (!module_output_close(&source, emitter_free(&out)))
+                return false;
+
+        snprintf(base, sizeof(base), "%.*s.h", (int) length, path);
+
+        if (!module_output_open(&definitions, base))
+                return false;
+
+        emitter_init_fd(&out, definitions.fd);
+        gen.out = &out;
+        gen_header(&gen);
+
+        if (!module_output_close(&definitions, emitter_free(&out)))
+                return false;
+
+        snprintf(base, sizeof(base), "%.*s%s", (int) length, path, MODULE_INTERFACE_EXTENSION);
+
+        return module_write_interface(program, base);
+}
+
+// Start the C compiler on the program. It reads the generated code from the returned descriptor
+static int c_compiler_start(struct semantics *sem, pid_t *pid)
+{
+        struct astnode *modules = sem->modules;
+        const char *arguments[modules->node_compound.count + c_argument_count + 12];
+        int count = 0;
+
+        arguments[count++] = c_compiler;
+
+        // Modules are included relative to the program, which the compiler cannot know when reading a pipe
+        arguments[count++] = "-I";
+        arguments[count++] = sem->directory;
+
+        arguments[count++] = "-x";
+        arguments[count++] = "c";
+        arguments[count++] = "-";
+
+        if (!object_only) {
+                arguments[count++] = "-x";
+                arguments[count++] = "none";
+
+                for (size_t i = 0; i < modules->node_compound.count; i++) {
+                        const char *base = modules->node_compound.array[i]->import.base;
+
+                        // Goes away along with the rest of the unit
+                        char *source = arena_alloc(ast_arena, strlen(base) + 3);
+                        sprintf(source, "%s.c", base);
+                        arguments[count++] = source;
+                }
+        }
+
+        for (int i = 0; i < c_argument_count; i++)
+                arguments[count++] = c_arguments[i];
+
+        if (object_only)
+                arguments[count++] = "-c";
+
+        arguments[count++] = "-o";
+        arguments[count++] = output_path;
+        arguments[count] = NULL;
+
+        int fds[2];
+
+        if (pipe(fds) != 0) {
+                printf("Could not start the C compiler: %s\n", strerror(errno));
+                return -1;
         }
 
+        // The compiler only gets to see the reading end, as its standard input
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        fflush(stdout);
+        *pid = fork();
+
+        if (*pid == 0) {
+                dup2(fds[0], STDIN_FILENO);
+                execvp(c_compiler, (char **) arguments);
+
+                printf("Could not start the C compiler \"%s\": %s\n", c_compiler, strerror(errno));
+                fflush(stdout);
+                _exit(127);
+        }
+
+        close(fds[0]);
+
+        if (*pid < 0) {
+                printf("Could not start the C compiler: %s\n", strerror(errno));
+                close(fds[1]);
+                return -1;
+        }
+
+        return fds[1];
+}
+
+// Wait for the C compiler, once it has everything. Stops it if the program could not be generated after all
+static _Bool c_compiler_finish(pid_t pid, _Bool success)
+{
+        int status;
+
+        if (!success)
+                kill(pid, SIGTERM);
+
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+        if (success && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                printf("-- C compilation failed --\n");
+                return false;
+        }
+
+        return success;
+}
+
+// For the time report. Lexing happens while parsing, so it is timed in a pass of its own, outside of the parsing phase
+static void profile_lexing(struct input_handle *handle)
+{
         struct lexer lex;
-        lexer_init(&lex, &handle);
+        struct lxtok tok;
+
+        profile_phase_end(PHASE_PARSE);
+        lexer_init(&lex, handle);
+
+        double start = profile_clock();
+
+        while (!lexer_empty(&lex) && lexer_next(&lex, &tok))
+                lxtok_free(&tok);
+
+        profile_lexed(profile_clock() - start);
+        profile_phase_begin(PHASE_PARSE);
+}
+
+/**
+ * Compile a single file. Programs (module == NULL) are compiled to output_path, modules to a .c/.h pair and
+ * an interface summary next to their source. Imported modules are compiled beforehand, in parallel.
+ **/
+static _Bool compile(const char *path, char *module)
+{
+        _Bool success = false;
+
+        // Its outputs from an earlier request are still up to date
+        if (module && server_unchanged(path))
+                return true;
 
+        profile_unit(path);
+        profile_phase_begin(PHASE_READ);
+
+        struct input_handle handle = empty_input_handle;
+        if (!input_read(path, &handle)) {
+                printf("Could not load input file \"%s\".\n", path);
+                return false;
+        }
+
+        profile_phase_end(PHASE_READ);
+
+        // Everything the compiler builds for this unit lives in one arena and is torn down at once
+        struct arena arena;
+        arena_init(&arena, ARENA_CHUNK_SIZE);
+        ast_arena = &arena;
+
+        profile_phase_begin(PHASE_PARSE);
+
+        struct lexer lex;
         struct parser p;
-        parser_init(&p, &lex);
+        _Bool parsed = false;
+
+        // Files read as a whole have their parsed tree kept in the cache, if there is one. Streams are always parsed
+        struct ast_image image = empty_ast_image;
+        struct astnode *node = NULL;
+        char *image_path = NULL;
+        uint64_t source_hash = 0;
 
-        struct astnode *node = parse(&p);
+        if (!handle.streaming) {
+                source_hash = hash_bytes(HASH_SEED, handle.buffer, handle.length);
+                node = server_tree(path, source_hash);
+        }
+
+        if (!handle.streaming && !node && cache)
+                image_path = ast_image_path(cache->directory, source_hash);
+
+        if (image_path)
+                node = ast_image_load(&image, image_path, source_hash, handle.length);
+
+        if (!node) {
+                if (profiling_report && !handle.streaming)
+                        profile_lexing(&handle);
+
+                lexer_init(&lex, &handle);
+                parser_init(&p, &lex);
+                parsed = true;
+
+                node = parse(&p);
+
+                // Before anything else gets to modify the tree
+                if (node && image_path)
+                        ast_image_store(image_path, node, source_hash, handle.length);
+        }
+
+        free(image_path);
+
+        profile_phase_end(PHASE_PARSE);
 
         if (!node) {
                 printf("-- Parsing failed --\n");
                 goto syntax_error;
         }
 
+        profile_phase_begin(PHASE_IMPORTS);
+
+        if (!modules_build(node, path, compile)) {
+                printf("-- Building imported modules failed --\n");
+                goto syntax_error;
+        }
+
+        profile_phase_end(PHASE_IMPORTS);
+
+        char *directory = module_directory(path);
+
         struct semantics sem;
-        semantics_init(&sem, p.types, node);
+        semantics_init(&sem, node);
+        sem.module = module;
+        sem.directory = directory;
+        sem.cache = cache;
+
+        profile_phase_begin(PHASE_ANALYZE);
 
         if (!analyze_program(&sem, node)) {
                 printf("-- Semantic analysis failed --\n");
                 goto semantics_error;
         }
 
-        ast_print(node, 0);
+        profile_phase_end(PHASE_ANALYZE);
 
         // --- Code generation
 
-        FILE *output = fopen("output.c", "wa");
+        if (module) {
+                profile_phase_begin(PHASE_GENERATE);
+                success = generate_module(node, &sem, path, module);
+                profile_phase_end(PHASE_GENERATE);
+                goto semantics_error;
+        }
+
+        ast_print(node, 0);
+
+        pid_t compiler = -1;
+        int output = program_output;
+
+        if (output < 0 && c_compiler)
+                output = c_compiler_start(&sem, &compiler);
+        else if (output < 0 && (output = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+                printf("Could not open the output file \"%s\": %s\n", output_path, strerror(errno));
+
+        if (output < 0)
+                goto semantics_error;
+
+        profile_phase_begin(PHASE_GENERATE);
+
+        struct emitter out;
+        emitter_init_fd(&out, output);
 
         struct codegen gen;
-        codegen_init(&gen, node, sem.stuff, output);
+        codegen_init(&gen, node, sem.stuff, &out);
+        gen.cache = cache;
         gen_generate(&gen);
 
-        fclose(output);
+        success = emitter_free(&out);
+
+        profile_phase_end(PHASE_GENERATE);
+
+        if (!success)
+                printf("Could not write the output file.\n");
+
+        if (output != program_output)
+                close(output);
+
+        if (compiler > 0)
+                success = c_compiler_finish(compiler, success);
 
         // ---
 
         semantics_error:
+        free(directory);
+
+        syntax_error:
 
-        astnode_free(node);
+        // Phases that failed are left out
+        profile_finish();
 
-        semantics_free(&sem);
+        if (parsed)
+                parser_free(&p);
 
-        syntax_error:
+        arena_free(&arena);
+        ast_arena = NULL;
 
-        parser_free(&p);
+        ast_image_close(&image);
 
         input_free(&handle);
 
-        return 0;
+        return success;
+}
+
+static _Bool compile_program(const char *path, int output)
+{
+        program_output = output;
+        return compile(path, NULL);
+}
+
+int main(int argc, char **argv)
+{
+//        print_license();
+
+        // "-" reads the program from standard input, e.g. when it is generated on the fly
+        const char *path = "input.poly";
+        const char *trace = NULL;
+        _Bool time_report = false;
+        _Bool memory_report = false;
+        const char *server = NULL;      // } The socket to serve compile requests on,
+        const char *remote = NULL;      // } or to send this one to
+        const char *watch = NULL;       // Compile again whenever a source file below this directory changes
+        const char *cache_directory = NULL;
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--time-report") == 0)
+                        time_report = true;
+                else if (strcmp(argv[i], "--mem-report") == 0)
+                        memory_report = true;
+                else if (strncmp(argv[i], "--trace=", strlen("--trace=")) == 0)
+                        trace = argv[i] + strlen("--trace=");
+                else if (strcmp(argv[i], "--cache") == 0)
+                        cache_directory = CACHE_DIRECTORY;
+                else if (strncmp(argv[i], "--cache-dir=", strlen("--cache-dir=")) == 0)
+                        cache_directory = argv[i] + strlen("--cache-dir=");
+                else if (strcmp(argv[i], "--server") == 0)
+                        server = SERVER_SOCKET;
+                else if (strncmp(argv[i], "--server=", strlen("--server=")) == 0)
+                        server = argv[i] + strlen("--server=");
+                else if (strcmp(argv[i], "--connect") == 0)
+                        remote = SERVER_SOCKET;
+                else if (strncmp(argv[i], "--connect=", strlen("--connect=")) == 0)
+                        remote = argv[i] + strlen("--connect=");
+                else if (strcmp(argv[i], "--watch") == 0) {
+                        if (i + 1 == argc) {
+                                printf("Missing the directory to watch.\n");
+                                return 1;
+                        }
+
+                        watch = argv[++i];
+                } else if (strcmp(argv[i], "--cc") == 0)
+                        c_compiler = getenv("CC") ? getenv("CC") : "cc";
+                else if (strncmp(argv[i], "--cc=", strlen("--cc=")) == 0)
+                        c_compiler = argv[i] + strlen("--cc=");
+                else if (strcmp(argv[i], "-c") == 0)
+                        object_only = true;
+                else if (strcmp(argv[i], "-o") == 0) {
+                        if (i + 1 == argc) {
+                                printf("Missing the output path.\n");
+                                return 1;
+                        }
+
+                        output_path = argv[++i];
+                } else if (strcmp(argv[i], "--") == 0) {
+                        // Everything else is meant for the C compiler
+                        c_arguments = argv + i + 1;
+                        c_argument_count = argc - i - 1;
+                        break;
+                } else if (argv[i][0] == '-' && argv[i][1] != 0) {
+                        printf("Unknown option \"%s\".\n", argv[i]);
+                        return 1;
+                } else
+                        path = argv[i];
+        }
+
+        if ((object_only || c_arguments) && !c_compiler) {
+                printf("Options for the C compiler require --cc.\n");
+                return 1;
+        }
+
+        if (c_compiler && (server || remote || watch)) {
+                printf("The C compiler can only be run when compiling directly.\n");
+                return 1;
+        }
+
+        if (!output_path)
+                output_path = !c_compiler ? "output.c" : object_only ? "output.o" : "a.out";
+
+        if (strcmp(output_path, "-") == 0 && (c_compiler || watch)) {
+                printf("The output can only be written to standard output when generating C code once.\n");
+                return 1;
+        }
+
+        if (watch && strcmp(path, "-") == 0) {
+                printf("Standard input cannot be watched for changes.\n");
+                return 1;
+        }
+
+        if (remote)
+                return server_request(remote, path, output_path) ? 0 : 1;
+
+        // The generated code goes to standard output, so everything we print has to make way
+        if (strcmp(output_path, "-") == 0 && !server) {
+                fflush(stdout);
+                program_output = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+
+        // A C compiler that gives up early must not take us down with it
+        if (c_compiler)
+                signal(SIGPIPE, SIG_IGN);
+
+        if ((time_report || trace) && !profile_init(time_report, trace))
+                return 1;
+
+        // Before anything is allocated, so that the arenas are accounted for from the start
+        if (memory_report)
+                profile_memory_init();
+
+        intern_init();
+
+        struct cache build_cache;
+
+        // Without it everything is simply generated from scratch
+        if (cache_directory && cache_open(&build_cache, cache_directory))
+                cache = &build_cache;
+
+        _Bool success = false;
+
+        if (server)
+                server_run(server, cache, compile_program);
+        else if (watch)
+                server_watch(watch, path, output_path, cache, compile_program);
+        else
+                success = compile(path, NULL);
+
+        profile_close();
+
+        if (cache)
+                cache_close(cache);
+
+        astdtype_free_all();
+        intern_free();
+
+        return success ? 0 : 1;
 }
@@ -0,0 +1,404 @@
+#include "module.h"
+#include "../common/io.h"
+#include "../common/intern.h"
+#include "../syntax/lexer.h"
+#include "../syntax/parser.h"
+#include "../syntax/syntax.h"
+#include "../codegen/emit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Canonical paths of the modules currently being compiled, outermost first. Inherited by child processes
+static char *import_chain[MODULE_MAX_DEPTH];
+static size_t chain_length = 0;
+
+char *module_name(const char *path)
+{
+        const char *start = strrchr(path, '/');
+        start = start ? start + 1 : path;
+
+        size_t length = strlen(start);
+        size_t extension = strlen(MODULE_SOURCE_EXTENSION);
+
+        if (length > extension && strcmp(start + length - extension, MODULE_SOURCE_EXTENSION) == 0)
+                length -= extension;
+
+        char name[length + 1];
+
+        for (size_t i = 0; i < length; i++)
+                name[i] = (char) (isalnum((unsigned char) start[i]) ? start[i] : '_');
+
+        name[length] = '\0';
+
+        return intern(name);
+}
+
+char *module_base(const char *directory, const char *path)
+{
+        size_t length = strlen(directory) + strlen(path) + 2;
+        char *base = malloc(length);
+
+        if (path[0] == '/' || strcmp(directory, ".") == 0)
+                snprintf(base, length, "%s", path);
+        else
+                snprintf(base, length, "%s/%s", directory, path);
+
+        return base;
+}
+
+char *module_directory(const char *path)
+{
+        const char *slash = strrchr(path, '/');
+
+        if (!slash)
+                return strdup(".");
+
+        if (slash == path)
+                return strdup("/");
+
+        return strndup(path, slash - path);
+}
+
+static _Bool chain_contains(const char *canonical)
+{
+        for (size_t i = 0; i < chain_length; i++)
+                if (strcmp(import_chain[i], canonical) == 0)
+                        return true;
+
+        return false;
+}
+
+static _Bool chain_push(const char *path)
+{
+        char *canonical = realpath(path, NULL);
+
+        if (!canonical) {
+                printf("Could not find module \"%s\".\n", path);
+                return false;
+        }
+
+        if (chain_contains(canonical)) {
+                printf("Circular import of module \"%s\".\n", path);
+                free(canonical);
+                return false;
+        }
+
+        if (chain_length == MODULE_MAX_DEPTH) {
+                printf("Imports are nested too deeply at module \"%s\".\n", path);
+                free(canonical);
+                return false;
+        }
+
+        import_chain[chain_length++] = canonical;
+        return true;
+}
+
+_Bool modules_build(struct astnode *program, const char *path, module_compiler compile)
+{
+        struct astnode *nodes = program->program.block->block.nodes;
+        char *directory = module_directory(path);
+        _Bool success = true;
+
+        // The outermost file enters the chain here, modules do when they are forked off. Standard input
+        // cannot be imported, so it never needs to be
+        if (chain_length == 0 && strcmp(path, "-") != 0 && !chain_push(path)) {
+                free(directory);
+                return false;
+        }
+
+        pid_t children[nodes->node_compound.count];
+        size_t child_count = 0;
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++) {
+                struct astnode *import = nodes->node_compound.array[i];
+
+                if (import->type != NODE_IMPORT)
+                        continue;
+
+                char *base = module_base(directory, import->import.path);
+                char source[strlen(base) + strlen(MODULE_SOURCE_EXTENSION) + 1];
+
+                sprintf(source, "%s%s", base, MODULE_SOURCE_EXTENSION);
+                free(base);
+
+                // Anything still buffered would otherwise be printed by the child as well
+                fflush(stdout);
+
+                pid_t pid = fork();
+
+                if (pid < 0) {
+                        printf("Could not start compiling module \"%s\": %s\n", source, strerror(errno));
+                        success = false;
+                        break;
+                }
+
+                if (pid == 0) {
+                        _Bool compiled = chain_push(source) && compile(source, module_name(source));
+                        fflush(stdout);
+                        _exit(compiled ? 0 : 1);
+                }
+
+                children[child_count++] = pid;
+        }
+
+        for (size_t i = 0; i < child_count; i++) {
+                int status;
+
+                while (waitpid(children[i], &status, 0) < 0 && errno == EINTR);
+
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                        success = false;
+        }
+
+        free(directory);
+
+        return success;
+}
+
+_Bool module_load_interface(struct astnode *import, const char *base, struct astnode *block)
+{
+        char path[strlen(base) + strlen(MODULE_INTERFACE_EXTENSION) + 1];
+        sprintf(path, "%s%s", base, MODULE_INTERFACE_EXTENSION);
+
+        struct input_handle handle = empty_input_handle;
+
+        if (!input_read(path, &handle))
+                return false;
+
+        struct lexer lex;
+        lexer_init(&lex, &handle);
+
+        struct parser p;
+        parser_init(&p, &lex);
+
+        // Parsed into a block of its own, but the declarations themselves belong to the global scope
+        struct astnode *scratch = astnode_empty_block(0, block);
+        struct astnode *parsed = parse_block_very_advanced(&p, false, scratch);
+
+        parser_free(&p);
+        input_free(&handle);
+
+        if (!parsed)
+                return false;
+
+        struct astnode *declarations = scratch->block.nodes;
+
+        for (size_t i = 0; i < declarations->node_compound.count; i++)
+                declarations->node_compound.array[i]->super = block;
+
+        import->import.declarations = declarations;
+
+        return true;
+}
+
+// Writes a compile-time constant back in Poly syntax
+static _Bool write_constant(struct emitter *out, struct astnode *expr)
+{
+        switch (expr->type) {
+                case NODE_INTEGER_LITERAL:
+                        emit_integer(out, expr->integer_literal.integerValue);
+                        return true;
+                case NODE_FLOAT_LITERAL:
+                        emit_format(out, "%f", expr->float_literal.floatValue);
+                        return true;
+                case NODE_STRING_LITERAL:
+                        emit_char(out, '"');
+                        emit_string(out, expr->string_literal.value);
+                        emit_char(out, '"');
+                        return true;
+                case NODE_BINARY_OP:
+                        emit_char(out, '(');
+                        if (!write_constant(out, expr->binary.left))
+                                return false;
+                        emit_char(out, ' ');
+                        emit_string(out, binaryop_cstr(expr->binary.op));
+                        emit_char(out, ' ');
+                        if (!write_constant(out, expr->binary.right))
+                                return false;
+                        emit_char(out, ')');
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+static void write_type(struct emitter *out, struct astdtype *type)
+{
+        char *str = astdtype_string(type);
+        emit_string(out, str);
+        free(str);
+}
+
+static _Bool write_parameters(struct emitter *out, struct astnode *params, _Bool defaults)
+{
+        emit_char(out, '(');
+
+        for (size_t i = 0; i < params->node_compound.count; i++) {
+                struct astnode *param = params->node_compound.array[i];
+
+                if (i > 0)
+                        emit_literal(out, ", ");
+
+                emit_string(out, param->declaration.identifier);
+                emit_literal(out, ": ");
+                write_type(out, param->declaration.type);
+
+                if (!defaults || !param->declaration.value)
+                        continue;
+
+                emit_literal(out, " default ");
+
+                if (!write_constant(out, param->declaration.value)) {
+                        printf("The default value of field \"%s\" cannot be exported. Error on line %ld.\n",
+                               param->declaration.identifier, param->line);
+                        return false;
+                }
+        }
+
+        emit_char(out, ')');
+        return true;
+}
+
+_Bool module_write_interface(struct astnode *program, const char *path)
+{
+        struct astnode *nodes = program->program.block->block.nodes;
+        struct module_output file;
+        struct emitter out;
+        _Bool success = true;
+
+        if (!module_output_open(&file, path))
+                return false;
+
+        emitter_init_fd(&out, file.fd);
+
+        for (size_t i = 0; i < nodes->node_compound.count && success; i++) {
+                struct astnode *node = nodes->node_compound.array[i];
+
+                switch (node->type) {
+                        case NODE_IMPORT:
+                                emit_literal(&out, "import \"");
+                                emit_string(&out, node->import.path);
+                                emit_literal(&out, "\"\n");
+                                break;
+                        case NODE_COMPLEX_TYPE:
+                                emit_literal(&out, "type ");
+                                emit_string(&out, node->type_definition.identifier);
+                                emit_char(&out, ' ');
+                                success = write_parameters(&out, node->type_definition.fields, true);
+                                emit_char(&out, '\n');
+                                break;
+                        case NODE_FUNCTION_DEFINITION:
+                                if (!node->function_def.identifier)
+                                        break;
+
+                                emit_literal(&out, "present ");
+                                emit_string(&out, node->function_def.identifier);
+                                success = write_parameters(&out, node->function_def.params, false);
+                                emit_literal(&out, " -> ");
+                                write_type(&out, node->function_def.type);
+                                emit_char(&out, '\n');
+                                break;
+                        default:
+                                break;
+                }
+        }
+
+        if (!emitter_free(&out))
+                success = false;
+
+        return module_output_close(&file, success);
+}
+
+_Bool module_output_open(struct module_output *file, const char *path)
+{
+        size_t length = strlen(path) + 32;
+
+        file->path = strdup(path);
+        file->temp = malloc(length);
+        snprintf(file->temp, length, "%s.%ld.tmp", path, (long) getpid());
+
+        file->fd = open(file->temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (file->fd < 0) {
+                printf("Could not create \"%s\": %s\n", file->temp, strerror(errno));
+                free(file->path);
+                free(file->temp);
+                return false;
+        }
+
+        return true;
+}
+
+// Whether two files have exactly the same content
+static _Bool same_content(const char *a, const char *b)
+{
+        int first = open(a, O_RDONLY);
+        int second = open(b, O_RDONLY);
+        _Bool same = first >= 0 && second >= 0;
+
+        char left[8192], right[8192];
+
+        while (same) {
+                ssize_t length = read(first, left, sizeof(left));
+
+                if (length < 0) {
+                        same = false;
+                        break;
+                }
+
+                // Reading the other file in pieces of the same size, unless it is shorter
+                ssize_t other = 0, got;
+
+                while (other < length && (got = read(second, right + other, length - other)) > 0)
+                        other += got;
+
+                if (other != length || memcmp(left, right, length) != 0)
+                        same = false;
+
+                if (length == 0) {
+                        same = same && read(second, right, 1) == 0;
+                        break;
+                }
+        }
+
+        if (first >= 0)
+                close(first);
+        if (second >= 0)
+                close(second);
+
+        return same;
+}
+
+_Bool module_output_close(struct module_output *file, _Bool success)
+{
+        if (close(file->fd) != 0)
+                success = false;
+
+        // Leaving an identical file untouched keeps its timestamp, so nothing compiling the C code redoes its work
+        if (success && same_content(file->temp, file->path)) {
+                unlink(file->temp);
+                free(file->path);
+                free(file->temp);
+                return true;
+        }
+
+        if (success && rename(file->temp, file->path) != 0) {
+                printf("Could not write \"%s\": %s\n", file->path, strerror(errno));
+                success = false;
+        }
+
+        if (!success)
+                unlink(file->temp);
+
+        free(file->path);
+        free(file->temp);
+
+        return success;
+}
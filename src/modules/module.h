@@ -0,0 +1,67 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "../common/ast.h"
+
+// Source files of modules carry this extension. Import paths leave it out
+#define MODULE_SOURCE_EXTENSION ".poly"
+
+// The interface summary of a compiled module, see module_write_interface
+#define MODULE_INTERFACE_EXTENSION ".polyi"
+
+// Imports may not nest any deeper than this
+#define MODULE_MAX_DEPTH 64
+
+// Compiles a single module to its output files. Takes the source path and the module name
+typedef _Bool (*module_compiler)(const char *, char *);
+
+/**
+ * The name of the module behind an import path: The file name without directories or extension, with
+ * everything that may not appear in a C identifier replaced by '_'. Interned.
+ **/
+char *module_name(const char *);
+
+/**
+ * The path of a module relative to the given directory, without an extension.
+ * The returned string has to be freed by the caller.
+ **/
+char *module_base(const char *directory, const char *path);
+
+// The directory part of a path, "." if there is none. Has to be freed by the caller
+char *module_directory(const char *);
+
+/**
+ * Compile all modules imported by the program, each in a process of its own, and wait for them.
+ * The path is the one of the importing file; imports are resolved relative to its directory.
+ * Fails on circular imports.
+ **/
+_Bool modules_build(struct astnode *program, const char *path, module_compiler);
+
+/**
+ * Parse the interface summary of an imported module into the 'declarations' of the import node.
+ * The declarations are placed into the given (global) block. The base path is the one of module_base.
+ **/
+_Bool module_load_interface(struct astnode *import, const char *base, struct astnode *block);
+
+/**
+ * Write the interface summary of an analyzed module: Its imports, exported types and the signatures
+ * of its functions, in Poly syntax. Importers read this instead of the module itself.
+ **/
+_Bool module_write_interface(struct astnode *program, const char *path);
+
+/**
+ * An output file. It is written under a temporary name and renamed into place once complete, so that
+ * concurrent builds of the same module never observe a partial file.
+ **/
+struct module_output {
+        char *path;
+        char *temp;
+        int fd;
+};
+
+_Bool module_output_open(struct module_output *, const char *);
+
+// Rename the file into place if successful, remove it otherwise. A file with the same content is left as it is
+_Bool module_output_close(struct module_output *, _Bool);
+
+#endif
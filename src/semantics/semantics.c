@@ -1,23 +1,347 @@
 #include "semantics.h"
 #include "semutil.h"
+#include "../common/intern.h"
+#include "../common/util.h"
+#include "../modules/module.h"
+#include "../common/profile.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 
+// A top-level node of the program, along with the state of its analysis
+struct analysis_unit {
+        struct astnode *node;
+        struct semantics sem;
+        _Bool pending; // The node is a function whose body still needs to be analyzed
+        _Bool success;
+
+        struct emitter *diagnostics;    // } What the analysis of the body reported, collected by the worker
+        size_t diagnostics_offset;      // } that analyzed it
+        size_t diagnostics_length;      // }
+};
+
+struct body_queue {
+        struct analysis_unit *units;
+        size_t count;
+        size_t next; // Only accessed atomically
+};
+
+struct body_worker {
+        pthread_t thread;
+        _Bool started;
+        size_t index;
+        struct body_queue *queue;
+        struct arena arena;
+        struct emitter diagnostics;
+};
+
+#define HASH_VALUE(hash, value) hash_bytes((hash), &(value), sizeof(value))
+
+static uint64_t hash_string(uint64_t hash, const char *str)
+{
+        return str ? hash_bytes(hash, str, strlen(str) + 1) : hash_bytes(hash, "", 1);
+}
+
+static uint64_t hash_complex(uint64_t, struct astnode *, struct astnode *);
+
+static uint64_t hash_type(uint64_t hash, struct astdtype *type, struct astnode *visited)
+{
+        hash = HASH_VALUE(hash, type->type);
+
+        switch (type->type) {
+                case ASTDTYPE_POINTER:
+                        return hash_type(hash, type->pointer.to, visited);
+                case ASTDTYPE_BUILTIN:
+                        return HASH_VALUE(hash, type->builtin.datatype);
+                case ASTDTYPE_COMPLEX:
+                        if (!type->complex.definition)
+                                return hash_string(hash, type->complex.name);
+
+                        return hash_complex(hash, type->complex.definition, visited);
+                default:
+                        return hash;
+        }
+}
+
+// Code using a type depends on the names of the type and its fields, as well as the default values
+static uint64_t hash_complex(uint64_t hash, struct astnode *def, struct astnode *visited)
+{
+        hash = hash_string(hash, def->type_definition.generated_identifier);
+
+        for (size_t i = 0; i < visited->node_compound.count; i++)
+                if (visited->node_compound.array[i] == def)
+                        return hash;
+
+        astnode_push_compound(visited, def);
+
+        hash = HASH_VALUE(hash, def->type_definition.digest);
+
+        struct astnode *fields = def->type_definition.fields;
+
+        for (size_t i = 0; i < fields->node_compound.count; i++) {
+                struct astnode *field = fields->node_compound.array[i];
+                hash = hash_string(hash, field->declaration.generated_id);
+                hash = hash_type(hash, field->declaration.type, visited);
+        }
+
+        return hash;
+}
+
+static uint64_t hash_params(uint64_t hash, struct astnode *params, struct astnode *visited)
+{
+        for (size_t i = 0; i < params->node_compound.count; i++)
+                hash = hash_type(hash, params->node_compound.array[i]->declaration.type, visited);
+
+        return HASH_VALUE(hash, params->node_compound.count);
+}
+
+// The interface of a global symbol: Whatever code referring to it is generated from or checked against
+static uint64_t hash_interface(struct astnode *node)
+{
+        struct astnode *visited = astnode_empty_compound(0, NULL);
+        uint64_t hash = HASH_VALUE(HASH_SEED, node->type);
+
+        switch (node->type) {
+                case NODE_FUNCTION_DEFINITION:
+                        hash = hash_string(hash, node->function_def.generated->generated_function.generated_id);
+                        hash = hash_type(hash, node->function_def.type, visited);
+                        return hash_params(hash, node->function_def.params, visited);
+                case NODE_PRESENT_FUNCTION:
+                        hash = hash_string(hash, node->present_function.link_name);
+                        hash = hash_type(hash, node->present_function.type, visited);
+                        return hash_params(hash, node->present_function.params, visited);
+                case NODE_VARIABLE_DECL:
+                        hash = hash_string(hash, node->declaration.generated_id);
+                        hash = HASH_VALUE(hash, node->declaration.constant);
+                        return hash_type(hash, node->declaration.type, visited);
+                case NODE_COMPLEX_TYPE:
+                        return hash_complex(hash, node, visited);
+                default:
+                        return hash;
+        }
+}
+
+static int compare_pointers(const void *a, const void *b)
+{
+        uintptr_t x = (uintptr_t) *(char **) a;
+        uintptr_t y = (uintptr_t) *(char **) b;
+
+        return (x > y) - (x < y);
+}
+
+/**
+ * The cache key of a function: Its own tokens and interface, and the interfaces of all global symbols it
+ * mentions by name. Types it only uses indirectly are part of those interfaces. Duplicate names are removed by
+ * sorting them by address, which differs between runs, so the interfaces are summed up instead of chained.
+ **/
+static uint64_t function_cache_key(struct semantics *sem, struct astnode *fdef)
+{
+        uint64_t key = hash_bytes(HASH_SEED, CACHE_VERSION, sizeof(CACHE_VERSION));
+
+        key = hash_string(key, sem->module);
+        key = HASH_VALUE(key, fdef->function_def.digest);
+
+        uint64_t own = hash_interface(fdef);
+        key = HASH_VALUE(key, own);
+
+        size_t count = fdef->function_def.reference_count;
+        char **references = malloc((count ? count : 1) * sizeof(char *));
+
+        memcpy(references, fdef->function_def.references, count * sizeof(char *));
+        qsort(references, count, sizeof(char *), compare_pointers);
+
+        uint64_t combined = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                if (i > 0 && references[i] == references[i - 1])
+                        continue;
+
+                struct astnode *sym = find_symbol(references[i], sem->program->program.block);
+
+                if (sym && sym->symbol.node != fdef)
+                        combined += hash_interface(sym->symbol.node);
+        }
+
+        free(references);
+
+        return HASH_VALUE(key, combined);
+}
+
+// Take the generated code of a function from the cache instead of analyzing its body. The key is kept either way
+static _Bool reuse_function(struct semantics *sem, struct astnode *fdef)
+{
+        fdef->function_def.cache_key = function_cache_key(sem, fdef);
+
+        return cache_load(sem->cache, fdef->function_def.cache_key, &fdef->function_def.cached,
+                          &fdef->function_def.cached_length);
+}
+
+#undef HASH_VALUE
+
+static void *analyze_bodies(struct body_worker *worker)
+{
+        struct body_queue *queue = worker->queue;
+        size_t i;
+
+        arena_init(&worker->arena, ARENA_CHUNK_SIZE);
+        ast_arena = &worker->arena;
+        semantics_collect_diagnostics(&worker->diagnostics);
+
+        while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count) {
+                struct analysis_unit *unit = &queue->units[i];
+
+                if (!unit->pending)
+                        continue;
+
+                semantics_enter_unit(i);
+
+                double start = profiling ? profile_clock() : 0;
+                char *name = FUNCTION_ID(unit->node->function_def.identifier);
+
+                unit->diagnostics = &worker->diagnostics;
+                unit->diagnostics_offset = worker->diagnostics.length;
+
+                if (unit->sem.cache && reuse_function(&unit->sem, unit->node)) {
+                        unit->success = true;
+                        profile_function(name, "body", worker->index, start, true);
+                } else {
+                        unit->success = analyze_function_body(&unit->sem, unit->node);
+                        profile_function(name, "body", worker->index, start, false);
+                }
+
+                unit->diagnostics_length = worker->diagnostics.length - unit->diagnostics_offset;
+        }
+
+        semantics_enter_unit(SIZE_MAX);
+        semantics_collect_diagnostics(NULL);
+        profile_collect();
+
+        return NULL;
+}
+
+// Analyze the bodies of all pending units on up to sem->threads threads
+static void analyze_pending_bodies(struct semantics *sem, struct analysis_unit *units, size_t count)
+{
+        size_t pending = 0;
+
+        for (size_t i = 0; i < count; i++)
+                if (units[i].pending)
+                        pending++;
+
+        size_t thread_count = sem->threads < pending ? sem->threads : pending;
+
+        if (thread_count == 0)
+                return;
+
+        struct body_queue queue = {.units = units, .count = count, .next = 0};
+        struct body_worker workers[thread_count];
+        struct arena *arena = ast_arena;
+
+        // The calling thread does its share of the work as the first worker
+        for (size_t i = 0; i < thread_count; i++) {
+                workers[i].queue = &queue;
+                workers[i].index = i;
+                emitter_init_memory(&workers[i].diagnostics);
+
+                workers[i].started = i > 0 &&
+                                     pthread_create(&workers[i].thread, NULL, (void *) analyze_bodies, &workers[i]) == 0;
+        }
+
+        analyze_bodies(&workers[0]);
+        ast_arena = arena;
+
+        for (size_t i = 1; i < thread_count; i++)
+                if (workers[i].started)
+                        pthread_join(workers[i].thread, NULL);
+
+        for (size_t i = 0; i < thread_count; i++)
+                if (i == 0 || workers[i].started)
+                        arena_adopt(arena, &workers[i].arena);
+
+        // In source order, just as if the bodies had been analyzed one after the other
+        for (size_t i = 0; i < count; i++)
+                if (units[i].pending && units[i].diagnostics_length > 0)
+                        fwrite(units[i].diagnostics->buffer + units[i].diagnostics_offset, 1,
+                               units[i].diagnostics_length, stdout);
+
+        for (size_t i = 0; i < thread_count; i++)
+                emitter_free(&workers[i].diagnostics);
+}
+
+/**
+ * The analysis runs in two phases. First, all top-level nodes are analyzed in source order, except for
+ * function bodies. Function bodies only depend on what the first phase declared globally, so they are
+ * analyzed concurrently afterwards, unless their generated code can be taken from the cache.
+ **/
 _Bool analyze_program(struct semantics *sem, struct astnode *program)
 {
-        if (!analyze_any(sem, program->program.block))
+        struct astnode *nodes = program->program.block->block.nodes;
+        size_t count = nodes->node_compound.count;
+        struct analysis_unit *units = arena_calloc(ast_arena, count ? count : 1, sizeof(struct analysis_unit));
+        _Bool success = true;
+
+        for (size_t i = 0; i < count; i++) {
+                struct analysis_unit *unit = &units[i];
+
+                unit->node = nodes->node_compound.array[i];
+                semantics_fork(sem, &unit->sem);
+                semantics_enter_unit(i);
+
+                if (unit->node->type == NODE_FUNCTION_DEFINITION) {
+                        double start = profiling ? profile_clock() : 0;
+                        unit->success = unit->pending = analyze_function_signature(&unit->sem, unit->node);
+                        profile_function(FUNCTION_ID(unit->node->function_def.identifier), "signature", 0, start,
+                                         false);
+                } else
+                        unit->success = analyze_any(&unit->sem, unit->node);
+
+                sem->pristine = unit->sem.pristine;
+        }
+
+        semantics_enter_unit(SIZE_MAX);
+
+        // Globals are named before the bodies are analyzed, as the cache keys of functions depend on them
+        for (size_t i = 0; i < count; i++)
+                semantics_join(sem, &units[i].sem);
+
+        analyze_pending_bodies(sem, units, count);
+
+        size_t functions = 0, reused = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                semantics_join(sem, &units[i].sem);
+
+                if (!units[i].success)
+                        success = false;
+
+                if (units[i].pending) {
+                        functions++;
+                        reused += units[i].node->function_def.cached != NULL;
+                }
+        }
+
+        if (!success)
                 return false;
 
+        // Part of the time report. Kept out of the diagnostics, which may be mixed with the generated program
+        if (sem->cache && profiling_report)
+                fprintf(stderr, "Reused the code of %ld out of %ld functions.\n", reused, functions);
+
+        // Modules are not run on their own
+        if (sem->module)
+                return true;
+
         struct astnode *sym;
 
-        if (!(sym = find_symbol("main", program->program.block))) {
-                printf("A void-typed main function could not be found.\n");
+        if (!(sym = find_symbol(NAME(MAIN), program->program.block))) {
+                diagnose("A void-typed main function could not be found.\n");
                 return false;
         }
 
         if (sym->symbol.symtype != SYMBOL_FUNCTION) {
-                printf("The symbol 'main' is a %s. Expected function. Conflict on line %ld.\n",
+                diagnose("The symbol 'main' is a %s. Expected function. Conflict on line %ld.\n",
                        symbol_type_humanstr(sym->symbol.symtype), sym->symbol.node->line);
                 return false;
         }
@@ -25,12 +349,12 @@ _Bool analyze_program(struct semantics *sem, struct astnode *program)
         struct astdtype *type = sym->symbol.node->function_def.type;
 
         if (type->type != ASTDTYPE_VOID) {
-                printf("Expected the main function to be of type void. Error on line %ld\n", sym->symbol.node->line);
+                diagnose("Expected the main function to be of type void. Error on line %ld\n", sym->symbol.node->line);
                 return false;
         }
 
         if (sym->symbol.node->function_def.params->node_compound.count != 0) {
-                printf("Expected the main function to have no parameters. Error on line %ld.\n",
+                diagnose("Expected the main function to have no parameters. Error on line %ld.\n",
                        sym->symbol.node->line);
                 return false;
         }
@@ -52,7 +376,7 @@ _Bool analyze_compound(struct semantics *sem, struct astnode *compound)
 _Bool analyze_block(struct semantics *sem, struct astnode *block)
 {
         if (!block->holder) {
-                printf("Dangling blocks are not allowed. Please use scopes to control variable visibility.\n");
+                diagnose("Dangling blocks are not allowed. Please use scopes to control variable visibility.\n");
                 return false;
         }
 
@@ -61,7 +385,7 @@ _Bool analyze_block(struct semantics *sem, struct astnode *block)
 
 _Bool analyze_any(struct semantics *sem, struct astnode *node)
 {
-        if (node->type != NODE_INCLUDE &&
+        if (node->type != NODE_INCLUDE && node->type != NODE_IMPORT &&
             !(node->type == NODE_BLOCK && node->holder && node->holder->type == NODE_PROGRAM))
                 sem->pristine = false;
 
@@ -89,6 +413,8 @@ _Bool analyze_any(struct semantics *sem, struct astnode *node)
                         return analyze_resolve(sem, node);
                 case NODE_INCLUDE:
                         return analyze_include(sem, node);
+                case NODE_IMPORT:
+                        return analyze_import(sem, node);
                 case NODE_NOTHING:
                         return true;
                 case NODE_PRESENT_FUNCTION:
@@ -98,7 +424,7 @@ _Bool analyze_any(struct semantics *sem, struct astnode *node)
                 case NODE_PATH:
                         return analyze_path(sem, node) != NULL;
                 default:
-                        printf("Unknown node type passed to analyze_any(..): %s\n", nodetype_string(node->type));
+                        diagnose("Unknown node type passed to analyze_any(..): %s\n", nodetype_string(node->type));
                         return false;
         }
 }
@@ -111,12 +437,12 @@ _Bool analyze_if(struct semantics *sem, struct astnode *_if)
         struct astdtype *type = analyze_expression(sem, _if->if_statement.expr, NULL, NULL);
 
         if (!type) {
-                printf("Type evaluation failed for if condition on line %ld.\n", _if->line);
+                diagnose("Type evaluation failed for if condition on line %ld.\n", _if->line);
                 return false;
         }
 
         if (type->type != ASTDTYPE_BUILTIN) {
-                printf("The if-expression on line %ld is invalid: The expression must evaluate to an effective builtin type.\n",
+                diagnose("The if-expression on line %ld is invalid: The expression must evaluate to an effective builtin type.\n",
                        _if->line);
                 return false;
         }
@@ -132,23 +458,32 @@ _Bool analyze_if(struct semantics *sem, struct astnode *_if)
         return true;
 }
 
-_Bool analyze_type(struct semantics *sem, struct astdtype *type, struct astnode *consumer)
+_Bool analyze_type(struct semantics *sem, struct astdtype **typeRef, struct astnode *consumer)
 {
+        struct astdtype *type = *typeRef;
+
         if (type->type != ASTDTYPE_COMPLEX && type->type != ASTDTYPE_POINTER)
                 return true;
 
-        if (type->type == ASTDTYPE_POINTER)
-                return analyze_type(sem, type->pointer.to, consumer);
+        if (type->type == ASTDTYPE_POINTER) {
+                struct astdtype *to = type->pointer.to;
+
+                if (!analyze_type(sem, &to, consumer))
+                        return false;
+
+                *typeRef = astdtype_pointer(to);
+                return true;
+        }
 
         struct astnode *sym = find_symbol(type->complex.name, consumer->super);
 
         if (!sym || (sym && sym->symbol.symtype != SYMBOL_TYPEDEF)) {
-                printf("The complex type \"%s\" does not exist. Error on line %ld.\n", type->complex.name,
+                diagnose("The complex type \"%s\" does not exist. Error on line %ld.\n", type->complex.name,
                        consumer->line);
                 return false;
         }
 
-        type->complex.definition = sym->symbol.node;
+        *typeRef = sym->symbol.type;
 
         return true;
 }
@@ -158,21 +493,21 @@ _Bool analyze_variable_declaration(struct semantics *sem, struct astnode *decl)
         if (symbol_conflict(decl->declaration.identifier, decl))
                 return false;
 
-        if (decl->declaration.type && !analyze_type(sem, decl->declaration.type, decl)) {
-                printf("The type of variable \"%s\" is invalid. Error on line %ld.\n", decl->declaration.identifier,
+        if (decl->declaration.type && !analyze_type(sem, &decl->declaration.type, decl)) {
+                diagnose("The type of variable \"%s\" is invalid. Error on line %ld.\n", decl->declaration.identifier,
                        decl->line);
                 return false;
         }
 
         // Type-inferred variables must have a value at the time of declaration
         if (!decl->declaration.type && !decl->declaration.value) {
-                printf("Type-inferred variables rely on a required initial expression to infer their types. Violation on line %ld.\n",
+                diagnose("Type-inferred variables rely on a required initial expression to infer their types. Violation on line %ld.\n",
                        decl->line);
                 return false;
         }
 
         if (decl->declaration.type && decl->declaration.type->type == ASTDTYPE_VOID) {
-                printf("Void is not a valid type for a variable. Error on line %ld.\n", decl->line);
+                diagnose("Void is not a valid type for a variable. Error on line %ld.\n", decl->line);
                 return false;
         }
 
@@ -184,20 +519,20 @@ _Bool analyze_variable_declaration(struct semantics *sem, struct astnode *decl)
         struct astdtype *exprType = analyze_expression(sem, UNWRAP(decl->declaration.value), &compile_time, NULL);
 
         if (!exprType) {
-                printf("Type evaluation failed for variable \"%s\" on line %ld.\n", decl->declaration.identifier,
+                diagnose("Type evaluation failed for variable \"%s\" on line %ld.\n", decl->declaration.identifier,
                        decl->line);
                 return false;
         }
 
         if (exprType->type == ASTDTYPE_VOID) {
-                printf("A variable may not be assigned to a void type. Violation on line %ld.\n", decl->line);
+                diagnose("A variable may not be assigned to a void type. Violation on line %ld.\n", decl->line);
                 return false;
         }
 
         _Bool uppermost = is_uppermost_block(decl->super);
 
         if (!compile_time && uppermost) {
-                printf("The value of variable \"%s\" is not strictly a compile-time constant and thus may not be used as the initial value of a global variable.\n",
+                diagnose("The value of variable \"%s\" is not strictly a compile-time constant and thus may not be used as the initial value of a global variable.\n",
                        decl->declaration.identifier);
                 return false;
         }
@@ -212,7 +547,7 @@ _Bool analyze_variable_declaration(struct semantics *sem, struct astnode *decl)
                 char *exprTypeStr = astdtype_string(exprType);
                 char *declTypeStr = astdtype_string(decl->declaration.type);
 
-                printf("The effective type of the expression (%s) is not compatible with the variable declaration type (%s) on line %ld.\n",
+                diagnose("The effective type of the expression (%s) is not compatible with the variable declaration type (%s) on line %ld.\n",
                        exprTypeStr, declTypeStr,
                        decl->line);
 
@@ -226,7 +561,7 @@ _Bool analyze_variable_declaration(struct semantics *sem, struct astnode *decl)
                    astnode_symbol(decl->super, SYMBOL_VARIABLE, decl->declaration.identifier, decl->declaration.type,
                                   decl));
 
-        declaration_generate_name(decl, sem->symbol_counter++);
+        semantics_name(sem, decl);
 
         return true;
 }
@@ -236,12 +571,12 @@ _Bool analyze_assignment(struct semantics *sem, struct astnode *assignment)
         struct astnode *target = analyze_path(sem, assignment->assignment.path);
 
         if (!target) {
-                printf("Assignment path is invalid. Error on line %ld.\n", assignment->line);
+                diagnose("Assignment path is invalid. Error on line %ld.\n", assignment->line);
                 return false;
         }
 
         if (target->type != NODE_VARIABLE_USE) {
-                printf("Attempted to assign %s as variable. Error on line %ld.\n", nodetype_string(assignment->type),
+                diagnose("Attempted to assign %s as variable. Error on line %ld.\n", nodetype_string(assignment->type),
                        assignment->line);
                 return false;
         }
@@ -253,12 +588,12 @@ _Bool analyze_assignment(struct semantics *sem, struct astnode *assignment)
         struct astdtype *exprType = analyze_expression(sem, assignment->assignment.value, NULL, NULL);
 
         if (!exprType) {
-                printf("Type validation of assignment expression failed on line %ld.\n", assignment->line);
+                diagnose("Type validation of assignment expression failed on line %ld.\n", assignment->line);
                 return false;
         }
 
         if (exprType->type == ASTDTYPE_VOID) {
-                printf("A variable may not be assigned to a void type. Violation on line %ld.\n", assignment->line);
+                diagnose("A variable may not be assigned to a void type. Violation on line %ld.\n", assignment->line);
                 return false;
         }
 
@@ -268,7 +603,7 @@ _Bool analyze_assignment(struct semantics *sem, struct astnode *assignment)
                 char *exprTypeStr = astdtype_string(exprType);
                 char *varTypeStr = astdtype_string(varType);
 
-                printf("Cannot assign \"%s\" (%s) to an expression of type %s. Type compatibility error on line %ld.\n",
+                diagnose("Cannot assign \"%s\" (%s) to an expression of type %s. Type compatibility error on line %ld.\n",
                        target->declaration.identifier, varTypeStr, exprTypeStr, assignment->line);
 
                 free(exprTypeStr);
@@ -280,14 +615,14 @@ _Bool analyze_assignment(struct semantics *sem, struct astnode *assignment)
         return true;
 }
 
-static struct semantics *_semantics;
+static _Thread_local struct semantics *_semantics;
 
 static void *declare_param_variable(struct astnode *fdef, struct astnode *variable)
 {
-        if (!analyze_type(_semantics, variable->declaration.type, variable))
+        if (!analyze_type(_semantics, &variable->declaration.type, variable))
                 return variable;
 
-        declaration_generate_name(variable, _semantics->symbol_counter++);
+        semantics_name(_semantics, variable);
 
         put_symbol(fdef->function_def.block,
                    astnode_symbol(fdef->function_def.block, SYMBOL_VARIABLE, variable->declaration.identifier,
@@ -297,7 +632,7 @@ static void *declare_param_variable(struct astnode *fdef, struct astnode *variab
 
 static void *analyze_linked_function_params(struct semantics *sem, struct astnode *param)
 {
-        if (!analyze_type(sem, param->declaration.type, param))
+        if (!analyze_type(sem, &param->declaration.type, param))
                 return param;
 
         return NULL;
@@ -309,7 +644,7 @@ _Bool analyze_present_function(struct semantics *sem, struct astnode *present)
                 return false;
 
         if (present->super->super) {
-                printf("A present function definition must be placed at the root of the program. Function \"%s\" violated this rule on line %ld.\n",
+                diagnose("A present function definition must be placed at the root of the program. Function \"%s\" violated this rule on line %ld.\n",
                        present->present_function.identifier, present->line);
                 return false;
         }
@@ -318,12 +653,18 @@ _Bool analyze_present_function(struct semantics *sem, struct astnode *present)
 
         if ((flawed_param = astnode_compound_foreach(present->present_function.params, sem,
                                                      (void *) analyze_linked_function_params))) {
-                printf("The type of parameter \"%s\" of function \"%s\" is invalid. Error on line %ld.\n",
+                diagnose("The type of parameter \"%s\" of function \"%s\" is invalid. Error on line %ld.\n",
                        flawed_param->declaration.identifier,
                        present->present_function.identifier, present->line);
                 return false;
         }
 
+        if (!analyze_type(sem, &present->present_function.type, present)) {
+                diagnose("Type analysis failed for return type of \"%s\". Error on line %ld.\n",
+                       present->present_function.identifier, present->line);
+                return false;
+        }
+
         put_symbol(present->super, astnode_symbol(present->super, SYMBOL_FUNCTION, present->present_function.identifier,
                                                   present->present_function.type, present));
 
@@ -331,18 +672,26 @@ _Bool analyze_present_function(struct semantics *sem, struct astnode *present)
 }
 
 _Bool analyze_function_definition(struct semantics *sem, struct astnode *fdef)
+{
+        if (!analyze_function_signature(sem, fdef))
+                return false;
+
+        return analyze_function_body(sem, fdef);
+}
+
+_Bool analyze_function_signature(struct semantics *sem, struct astnode *fdef)
 {
         if (symbol_conflict(fdef->function_def.identifier, fdef))
                 return false;
 
-        if (!analyze_type(sem, fdef->function_def.type, fdef)) {
-                printf("Type analysis failed for return type of \"%s\". Error on line %ld.\n",
+        if (!analyze_type(sem, &fdef->function_def.type, fdef)) {
+                diagnose("Type analysis failed for return type of \"%s\". Error on line %ld.\n",
                        fdef->function_def.identifier, fdef->line);
                 return false;
         }
 
         if (fdef->super && fdef->super->holder && fdef->super->holder->type != NODE_PROGRAM) {
-                printf("Functions must be declared in the global scope. Error on line %ld.\n", fdef->line);
+                diagnose("Functions must be declared in the global scope. Error on line %ld.\n", fdef->line);
                 return false;
         }
 
@@ -352,7 +701,7 @@ _Bool analyze_function_definition(struct semantics *sem, struct astnode *fdef)
 
         if ((flawed_param = astnode_compound_foreach(fdef->function_def.params, fdef,
                                                      (void *) declare_param_variable))) {
-                printf("The provided type for parameter variable \"%s\" of function \"%s\" is invalid. Error on line %ld.\n",
+                diagnose("The provided type for parameter variable \"%s\" of function \"%s\" is invalid. Error on line %ld.\n",
                        flawed_param->declaration.identifier, fdef->function_def.identifier, flawed_param->line);
                 return false;
         }
@@ -366,80 +715,89 @@ _Bool analyze_function_definition(struct semantics *sem, struct astnode *fdef)
                                         fdef->function_def.type,
                                         fdef));
 
+        // The body sees its own function through the symbol above. Bodies of other functions only see the
+        // global symbol if they come further down the program, no matter when they are analyzed.
+        if (fdef->function_def.identifier)
+                put_symbol(fdef->super, astnode_copy_symbol(sym));
+
+        fdef->function_def.param_count = fdef->function_def.params->node_compound.count;
+
+        if (sem->module && fdef->function_def.identifier)
+                fdef->function_def.module = sem->module;
+
+        semantics_name(sem, fdef);
+
+        return true;
+}
+
+_Bool analyze_function_body(struct semantics *sem, struct astnode *fdef)
+{
         if (!analyze_any(sem, fdef->function_def.block))
                 return false;
 
-
-        if (has_attribute(fdef->function_def.attributes, "no_return_checks"))
+        if (has_attribute(fdef->function_def.attributes, NAME(NO_RETURN_CHECKS)))
                 goto skip_return_checks;
 
         if (!fdef->function_def.conditionless_resolve && fdef->function_def.type->type != ASTDTYPE_VOID) {
-                printf("The non-void function \"%s\" declared on line %ld does not have an always-reachable resolve statement.\n",
+                diagnose("The non-void function \"%s\" declared on line %ld does not have an always-reachable resolve statement.\n",
                        FUNCTION_ID(fdef->function_def.identifier), fdef->line);
                 return false;
         }
 
         skip_return_checks:
 
-        // It's important to make the function available in the global scope only after analyzing the function block
-        if (fdef->function_def.identifier)
-                put_symbol(fdef->super, astnode_copy_symbol(sym));
-
-        semantics_new_function(sem, fdef);
-
-        fdef->function_def.param_count = fdef->function_def.params->node_compound.count;
-
         return true;
 }
 
 void *analyze_complex_type_field(struct semantics *sem, struct astnode *field)
 {
-        struct astdtype *type = field->declaration.type;
-
-        if (!analyze_type(sem, type, field))
+        if (!analyze_type(sem, &field->declaration.type, field))
                 return field;
 
+        struct astdtype *type = field->declaration.type;
+
         if (field->declaration.value) {
                 _Bool compileTime;
                 struct astdtype *exprType = analyze_expression(sem, field->declaration.value, &compileTime, NULL);
 
                 if (!exprType) {
-                        printf("Type analysis failed for default expression of field \"%s\" on line %ld.\n",
+                        diagnose("Type analysis failed for default expression of field \"%s\" on line %ld.\n",
                                field->declaration.identifier, field->line);
                         return field;
                 }
 
                 if (!compileTime) {
-                        printf("The default value for field \"%s\" is not a compile-time constant. Error on line %ld.\n",
+                        diagnose("The default value for field \"%s\" is not a compile-time constant. Error on line %ld.\n",
                                field->declaration.identifier, field->line);
                         return field;
                 }
 
                 if (!types_compatible(type, exprType)) {
-                        printf("The type of field \"%s\" is not compatible with the assigned default value. Error on line %ld.\n",
+                        diagnose("The type of field \"%s\" is not compatible with the assigned default value. Error on line %ld.\n",
                                field->declaration.identifier, field->line);
                         return field;
                 }
         }
 
-        declaration_generate_name(field, sem->symbol_counter++);
+        semantics_name(sem, field);
         return NULL;
 }
 
 _Bool analyze_complex_type(struct semantics *sem, struct astnode *def)
 {
         if (astnode_compound_foreach(def->type_definition.fields, sem, (void *) analyze_complex_type_field)) {
-                printf("Type analysis failed for fields of type \"%s\". Error on line %ld.\n",
+                diagnose("Type analysis failed for fields of type \"%s\". Error on line %ld.\n",
                        def->type_definition.identifier, def->line);
                 return false;
         }
 
-        complex_type_generate_name(def, sem->symbol_counter++);
+        // Global types of a module are exported
+        if (sem->module && is_uppermost_block(def->super) && !def->type_definition.module)
+                def->type_definition.module = sem->module;
 
-        struct astdtype *type = astdtype_complex(def->type_definition.identifier);
-        type->complex.definition = def;
+        semantics_name(sem, def);
 
-        semantics_new_type(sem, type);
+        struct astdtype *type = astdtype_complex(def->type_definition.identifier, def);
 
         put_symbol(def->super, astnode_symbol(def->super, SYMBOL_TYPEDEF, def->type_definition.identifier, type, def));
 
@@ -455,7 +813,7 @@ _Bool analyze_resolve(struct semantics *sem, struct astnode *res)
                 return false;
 
         if (!(function = find_enclosing_function(res->super))) {
-                printf("A resolve statement may only be placed inside of a function. Violation on line %ld.\n",
+                diagnose("A resolve statement may only be placed inside of a function. Violation on line %ld.\n",
                        res->line);
                 return false;
         }
@@ -464,7 +822,7 @@ _Bool analyze_resolve(struct semantics *sem, struct astnode *res)
                 char *exprType = astdtype_string(type);
                 char *fnType = astdtype_string(function->function_def.type);
 
-                printf("The resolve statement expression type (%s) is not compatible with the function type (%s) on line %ld.\n",
+                diagnose("The resolve statement expression type (%s) is not compatible with the function type (%s) on line %ld.\n",
                        exprType, fnType, res->line);
 
                 free(exprType);
@@ -484,7 +842,7 @@ _Bool analyze_resolve(struct semantics *sem, struct astnode *res)
 _Bool analyze_include(struct semantics *sem, struct astnode *include)
 {
         if (!sem->pristine) {
-                printf("Include statements must be located at the very top of the file. Error on line %ld.\n",
+                diagnose("Include statements must be located at the very top of the file. Error on line %ld.\n",
                        include->line);
                 return false;
         }
@@ -494,6 +852,81 @@ _Bool analyze_include(struct semantics *sem, struct astnode *include)
         return true;
 }
 
+// Declare what the interface of an imported module exports. Imports found in interfaces are resolved
+// relative to the directory of the interface
+static _Bool analyze_module_interface(struct semantics *sem, struct astnode *import, const char *directory)
+{
+        import->import.module = module_name(import->import.path);
+
+        // A module can be reached more than once, e.g. through the interfaces of other modules
+        for (size_t i = 0; i < sem->modules->node_compound.count; i++)
+                if (sem->modules->node_compound.array[i]->import.module == import->import.module)
+                        return true;
+
+        astnode_push_compound(sem->modules, import);
+
+        char *base = module_base(directory, import->import.path);
+        import->import.base = intern(base);
+
+        char *interfaceDirectory = module_directory(base);
+        _Bool success = module_load_interface(import, base, import->super);
+
+        if (!success) {
+                diagnose("Could not load the interface of module \"%s\". Error on line %ld.\n", import->import.path,
+                       import->line);
+                goto exit;
+        }
+
+        struct astnode *declarations = import->import.declarations;
+
+        for (size_t i = 0; i < declarations->node_compound.count && success; i++) {
+                struct astnode *decl = declarations->node_compound.array[i];
+
+                switch (decl->type) {
+                        case NODE_IMPORT:
+                                success = analyze_module_interface(sem, decl, interfaceDirectory);
+                                break;
+                        case NODE_COMPLEX_TYPE:
+                                decl->type_definition.module = import->import.module;
+                                success = analyze_complex_type(sem, decl);
+                                break;
+                        case NODE_PRESENT_FUNCTION:
+                                decl->present_function.link_name = module_symbol_name("fn", import->import.module,
+                                                                                      decl->present_function.identifier);
+                                success = analyze_present_function(sem, decl);
+                                break;
+                        default:
+                                diagnose("Unexpected %s in the interface of module \"%s\".\n", nodetype_string(decl->type),
+                                       import->import.path);
+                                success = false;
+                                break;
+                }
+        }
+
+        exit:
+        free(base);
+        free(interfaceDirectory);
+
+        return success;
+}
+
+_Bool analyze_import(struct semantics *sem, struct astnode *import)
+{
+        if (!sem->pristine) {
+                diagnose("Import statements must be located at the very top of the file. Error on line %ld.\n",
+                       import->line);
+                return false;
+        }
+
+        if (!analyze_module_interface(sem, import, sem->directory))
+                return false;
+
+        // The code generator includes the header of the module
+        astnode_push_compound(sem->stuff, import);
+
+        return true;
+}
+
 static struct astdtype *analyze_path_as_expression(struct semantics *, struct astnode *);
 
 struct astdtype *analyze_expression(struct semantics *sem, struct astnode *expr, _Bool *compile_time, struct astnode *def)
@@ -537,7 +970,7 @@ struct astdtype *analyze_binary_expression(struct semantics *sem, struct astnode
                 char *leftType = astdtype_string(left);
                 char *rightType = astdtype_string(right);
 
-                printf("Cannot perform binary operation between %s and %s on line %ld.\n", leftType, rightType,
+                diagnose("Cannot perform binary operation between %s and %s on line %ld.\n", leftType, rightType,
                        bin->line);
 
                 free(leftType);
@@ -566,7 +999,7 @@ static struct astdtype *analyze_path_as_expression(struct semantics *sem, struct
         if (res->type == NODE_FUNCTION_CALL)
                 return res->function_call.definition->function_def.type;
 
-        printf("Could not extract expression type from \"%s\". Error on line %ld.\n", nodetype_string(res->type),
+        diagnose("Could not extract expression type from \"%s\". Error on line %ld.\n", nodetype_string(res->type),
                path->line);
 
         return NULL;
@@ -602,7 +1035,7 @@ struct astnode *analyze_path(struct semantics *sem, struct astnode *path)
                         lastExpr = expr;
                         lastType = analyze_expression(sem, expr, NULL, NULL);
                         if (!lastType) {
-                                printf("Semantic analysis failed for path on line %ld.\n", path->line);
+                                diagnose("Semantic analysis failed for path on line %ld.\n", path->line);
                                 return NULL;
                         }
 
@@ -622,7 +1055,7 @@ struct astnode *analyze_path(struct semantics *sem, struct astnode *path)
                 // first need to figure out an identifier for the requested field.
 
                 if (lastType->type != ASTDTYPE_COMPLEX) {
-                        printf("A builtin lastType may only constitute the terminal pathSegment of a path. Error on line %ld.\n",
+                        diagnose("A builtin lastType may only constitute the terminal pathSegment of a path. Error on line %ld.\n",
                                path->line);
                         return NULL;
                 }
@@ -634,7 +1067,7 @@ struct astnode *analyze_path(struct semantics *sem, struct astnode *path)
                 else if (expr->type == NODE_FUNCTION_CALL)
                         id = expr->function_call.identifier;
                 else {
-                        printf("Unexpected pathSegment found when analyzing path expression (%s). Error on line %ld.\n",
+                        diagnose("Unexpected pathSegment found when analyzing path expression (%s). Error on line %ld.\n",
                                nodetype_string(expr->type), expr->line);
                         return NULL;
                 }
@@ -644,7 +1077,7 @@ struct astnode *analyze_path(struct semantics *sem, struct astnode *path)
                 lastExpr = expr;
 
                 if (!def) {
-                        printf("The complex type \"%s\" does not contain an element named \"%s\". Invalid path. Error on line %ld.\n",
+                        diagnose("The complex type \"%s\" does not contain an element named \"%s\". Invalid path. Error on line %ld.\n",
                                lastType->complex.name, id, expr->line);
                         return NULL;
                 }
@@ -652,7 +1085,7 @@ struct astnode *analyze_path(struct semantics *sem, struct astnode *path)
                 lastType = analyze_expression(sem, expr, NULL, def);
 
                 if (!lastType) {
-                        printf("Failed to analyze path on line %ld.\n", path->line);
+                        diagnose("Failed to analyze path on line %ld.\n", path->line);
                         return NULL;
                 }
 
@@ -683,12 +1116,12 @@ struct astdtype *analyze_variable_use(struct semantics *sem, struct astnode *use
         }
 
         if (!(symbol = find_symbol(use->variable.identifier, use->super))) {
-                printf("Undefined symbol '%s' referenced on line %ld.\n", use->variable.identifier, use->line);
+                diagnose("Undefined symbol '%s' referenced on line %ld.\n", use->variable.identifier, use->line);
                 return NULL;
         }
 
         if (symbol->symbol.symtype != SYMBOL_VARIABLE) {
-                printf("Non-variable symbol '%s' (%s) referenced in variable context on line %ld.\n",
+                diagnose("Non-variable symbol '%s' (%s) referenced in variable context on line %ld.\n",
                        use->variable.identifier,
                        symbol_type_humanstr(symbol->symbol.symtype), use->line);
                 return NULL;
@@ -709,7 +1142,7 @@ struct astdtype *analyze_atom(struct semantics *sem, struct astnode *atom, _Bool
         if (atom->type == NODE_INTEGER_LITERAL) {
                 struct astdtype *type = required_type_integer(sem, atom->integer_literal.integerValue);
                 if (!type) {
-                        printf("Could not find appropriate builtin type for the provided integer literal on line %ld.\n",
+                        diagnose("Could not find appropriate builtin type for the provided integer literal on line %ld.\n",
                                atom->line);
                         return NULL;
                 }
@@ -721,7 +1154,7 @@ struct astdtype *analyze_atom(struct semantics *sem, struct astnode *atom, _Bool
 
         if (atom->type == NODE_STRING_LITERAL) {
                 if (atom->holder && atom->holder->type == NODE_BINARY_OP) {
-                        printf("A string literal cannot be part of a binary expression. Violation (\"%s\") on line %ld.\n",
+                        diagnose("A string literal cannot be part of a binary expression. Violation (\"%s\") on line %ld.\n",
                                atom->string_literal.value, atom->line);
                         return NULL;
                 }
@@ -741,31 +1174,31 @@ struct astdtype *analyze_atom(struct semantics *sem, struct astnode *atom, _Bool
                 if (atom->pointer.target->type == NODE_PATH) {
                         target = analyze_path(sem, atom->pointer.target);
                         if (!target) {
-                                printf("Invalid path on line %ld.\n", atom->line);
+                                diagnose("Invalid path on line %ld.\n", atom->line);
                                 return NULL;
                         }
                 } else target = atom->pointer.target;
 
                 if (target->type != NODE_VARIABLE_USE) {
-                        printf("A pointer can only be created to a variable. Error on line %ld.\n", atom->line);
+                        diagnose("A pointer can only be created to a variable. Error on line %ld.\n", atom->line);
                         return NULL;
                 }
 
                 struct astdtype *exprType = analyze_expression(sem, target, compile_time, target->variable.var);
 
                 if (!exprType) {
-                        printf("Could not create pointer on line %ld: Type checking failed.\n", atom->line);
+                        diagnose("Could not create pointer on line %ld: Type checking failed.\n", atom->line);
                         return NULL;
                 }
 
                 if (exprType->type == ASTDTYPE_VOID) {
                         char *typeStr = astdtype_string(exprType);
-                        printf("Cannot create pointer to type %s. Error on line %ld.\n", typeStr, atom->line);
+                        diagnose("Cannot create pointer to type %s. Error on line %ld.\n", typeStr, atom->line);
                         free(typeStr);
                         return NULL;
                 }
 
-                return semantics_new_type(sem, astdtype_pointer(exprType));
+                return astdtype_pointer(exprType);
         }
 
         if (atom->type == NODE_DEREFERENCE) {
@@ -774,26 +1207,26 @@ struct astdtype *analyze_atom(struct semantics *sem, struct astnode *atom, _Bool
                 if (atom->dereference.target->type == NODE_PATH) {
                         target = analyze_path(sem, atom->pointer.target);
                         if (!target) {
-                                printf("Invalid path on line %ld.\n", atom->line);
+                                diagnose("Invalid path on line %ld.\n", atom->line);
                                 return NULL;
                         }
                 } else target = atom->dereference.target;
 
                 if (target->type != NODE_VARIABLE_USE) {
-                        printf("Only a variable may be dereferenced. Error on line %ld.\n", atom->line);
+                        diagnose("Only a variable may be dereferenced. Error on line %ld.\n", atom->line);
                         return NULL;
                 }
 
                 struct astdtype *exprType = analyze_expression(sem, target, compile_time, target->variable.var);
 
                 if (!exprType) {
-                        printf("Could not dereference on line %ld: Type checking failed.\n", atom->line);
+                        diagnose("Could not dereference on line %ld: Type checking failed.\n", atom->line);
                         return NULL;
                 }
 
                 if (exprType->type != ASTDTYPE_POINTER) {
                         char *typeStr = astdtype_string(exprType);
-                        printf("Cannot dereference a non-pointer type %s. Error on line %ld.\n", typeStr, atom->line);
+                        diagnose("Cannot dereference a non-pointer type %s. Error on line %ld.\n", typeStr, atom->line);
                         free(typeStr);
                         return NULL;
                 }
@@ -815,13 +1248,13 @@ struct astdtype *analyze_function_call(struct semantics *sem, struct astnode *ca
         }
 
         if (!(symbol = find_symbol(call->function_call.identifier, call->super))) {
-                printf("Attempting to call undefined function \"%s\". Error on line %ld.\n",
+                diagnose("Attempting to call undefined function \"%s\". Error on line %ld.\n",
                        FUNCTION_ID(call->function_call.identifier), call->line);
                 return NULL;
         }
 
         if (symbol->symbol.symtype != SYMBOL_FUNCTION) {
-                printf("Attempting to call %s \"%s\" as function. Error on line %ld.\n",
+                diagnose("Attempting to call %s \"%s\" as function. Error on line %ld.\n",
                        symbol_type_humanstr(symbol->symbol.symtype), symbol->symbol.identifier, call->line);
                 return NULL;
         }
@@ -842,7 +1275,7 @@ struct astdtype *analyze_function_call(struct semantics *sem, struct astnode *ca
         if (required_params != provided_params) {
                 char *typeStr = astdtype_string(definition->function_def.type);
 
-                printf("The function \"%s\" (%s) expects %ld params. %ld Parameters were provided in the call. Error on line %ld\n",
+                diagnose("The function \"%s\" (%s) expects %ld params. %ld Parameters were provided in the call. Error on line %ld\n",
                        FUNCTION_ID(call->function_call.identifier), typeStr, required_params,
                        provided_params, call->line);
 
@@ -870,7 +1303,7 @@ struct astdtype *analyze_function_call(struct semantics *sem, struct astnode *ca
                         char *paramType = astdtype_string(reqParamType);
                         char *exprType = astdtype_string(valueType);
 
-                        printf("The expression type \"%s\" is not compatible with the parameter number %ld \"%s\" (%s) of function \"%s\". Error on line %ld.\n",
+                        diagnose("The expression type \"%s\" is not compatible with the parameter number %ld \"%s\" (%s) of function \"%s\". Error on line %ld.\n",
                                exprType, i + 1, param->declaration.identifier, paramType,
                                FUNCTION_ID(definition->function_def.identifier), call->line);
 
@@ -17,7 +17,8 @@ _Bool analyze_any(struct semantics *, struct astnode *);
 
 _Bool analyze_if(struct semantics *, struct astnode *);
 
-_Bool analyze_type(struct semantics *, struct astdtype *, struct astnode *);
+// Resolves the names of complex types, replacing the type by one referring to their definitions
+_Bool analyze_type(struct semantics *, struct astdtype **, struct astnode *);
 
 _Bool analyze_variable_declaration(struct semantics *, struct astnode *);
 
@@ -25,12 +26,20 @@ _Bool analyze_present_function(struct semantics *, struct astnode *);
 
 _Bool analyze_function_definition(struct semantics *, struct astnode *);
 
+// Everything about a function that other top-level nodes depend upon. Makes the function visible globally
+_Bool analyze_function_signature(struct semantics *, struct astnode *);
+
+// May run concurrently for different functions, once all signatures have been analyzed
+_Bool analyze_function_body(struct semantics *, struct astnode *);
+
 _Bool analyze_complex_type(struct semantics *, struct astnode *);
 
 _Bool analyze_resolve(struct semantics *, struct astnode *);
 
 _Bool analyze_include(struct semantics *, struct astnode *);
 
+_Bool analyze_import(struct semantics *, struct astnode *);
+
 _Bool analyze_assignment(struct semantics *, struct astnode *);
 
 struct astdtype *analyze_expression(struct semantics *, struct astnode *, _Bool *, struct astnode *);
@@ -1,9 +1,19 @@
 #include "semutil.h"
+#include "symtable.h"
+#include "../common/intern.h"
+#include "../common/util.h"
+#include "../common/profile.h"
 
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 
-void semantics_init(struct semantics *sem, struct astnode *types, struct astnode *program)
+static _Thread_local size_t current_unit = SIZE_MAX;
+static _Thread_local struct emitter *diagnostics = NULL;
+
+static void compatibility_cache_clear(void);
+
+void semantics_init(struct semantics *sem, struct astnode *program)
 {
         sem->int8 = astdtype_builtin(BUILTIN_INT8);
         sem->int16 = astdtype_builtin(BUILTIN_INT16);
@@ -13,45 +23,125 @@ void semantics_init(struct semantics *sem, struct astnode *types, struct astnode
         sem->_double = astdtype_builtin(BUILTIN_DOUBLE);
         sem->_void = astdtype_void();
         sem->string = astdtype_string_type();
-        sem->stuff = types;
+        sem->stuff = astnode_empty_compound(0, NULL);
         sem->symbol_counter = 0;
+        sem->named = astnode_empty_compound(0, NULL);
         sem->pristine = true;
 
+        sem->threads = cpu_count();
+
+        sem->module = NULL;
+        sem->directory = ".";
+        sem->modules = astnode_empty_compound(0, NULL);
+
+        sem->cache = NULL;
+
         sem->program = program;
 
-        semantics_new_include(sem, "inttypes.h");
+        // Types of an earlier compile in the same process (see server_run) are gone, their results with them
+        compatibility_cache_clear();
+
+        semantics_new_include(sem, intern("inttypes.h"));
 }
 
-void semantics_free(struct semantics *sem)
+void semantics_fork(struct semantics *parent, struct semantics *child)
 {
-        astdtype_free(sem->int8);
-        astdtype_free(sem->int16);
-        astdtype_free(sem->int32);
-        astdtype_free(sem->int64);
-        astdtype_free(sem->byte);
-        astdtype_free(sem->_double);
-        astdtype_free(sem->_void);
-        astdtype_free(sem->string);
+        *child = *parent;
+        child->stuff = astnode_empty_compound(0, NULL);
+        child->named = astnode_empty_compound(0, NULL);
+        child->symbol_counter = 0;
 }
 
-static struct astnode *filter_symbol(char *id, struct astnode *node)
+// Parameters and everything declared inside of a function body
+static _Bool is_local(struct astnode *node)
 {
-        if (!id)
-                return NULL;
+        if (node->holder && node->holder->type == NODE_COMPOUND && node->holder->holder &&
+            node->holder->holder->type == NODE_FUNCTION_DEFINITION)
+                return true;
 
-        if (node->type != NODE_SYMBOL)
-                return NULL;
+        return node->super && !is_uppermost_block(node->super);
+}
 
-        if (strcmp(node->symbol.identifier, id) != 0)
+void semantics_join(struct semantics *parent, struct semantics *child)
+{
+        for (size_t i = 0; i < child->named->node_compound.count; i++) {
+                struct astnode *node = child->named->node_compound.array[i];
+                _Bool local = is_local(node);
+
+                // Locals are numbered by the child, so they only depend on the function they are declared in
+                size_t *counter = local ? &child->symbol_counter : &parent->symbol_counter;
+
+                switch (node->type) {
+                        case NODE_VARIABLE_DECL:
+                                declaration_generate_name(node, (*counter)++, local);
+                                break;
+                        case NODE_COMPLEX_TYPE:
+                                complex_type_generate_name(node, (*counter)++, local);
+                                break;
+                        case NODE_FUNCTION_DEFINITION:
+                                semantics_new_function(parent, node);
+                                break;
+                        default:
+                                break;
+                }
+        }
+
+        for (size_t i = 0; i < child->stuff->node_compound.count; i++)
+                astnode_push_compound(parent->stuff, child->stuff->node_compound.array[i]);
+
+        child->named->node_compound.count = 0;
+        child->stuff->node_compound.count = 0;
+}
+
+void semantics_enter_unit(size_t unit)
+{
+        current_unit = unit;
+}
+
+void semantics_collect_diagnostics(struct emitter *collector)
+{
+        diagnostics = collector;
+}
+
+void diagnose(const char *fmt, ...)
+{
+        va_list args;
+
+        va_start(args, fmt);
+
+        if (diagnostics)
+                emit_vformat(diagnostics, fmt, args);
+        else
+                vprintf(fmt, args);
+
+        va_end(args);
+}
+
+// The block to be searched after the given one, or NULL if the traversal is over
+static struct astnode *next_scope(struct astnode *b, enum traverse_params domain)
+{
+        if (!(domain & TRAVERSE_HALT_NESTED) || !b->holder || b->holder->type != NODE_FUNCTION_DEFINITION)
+                return b->super;
+
+        if (!(domain & TRAVERSE_GLOBAL_REGARDLESS))
                 return NULL;
 
-        return node;
+        // Traverse the tree up all the way up until the global scope
+        while (true) {
+                if (!b || !b->holder)
+                        return NULL;
+
+                if (b->holder->type == NODE_PROGRAM)
+                        return b;
+
+                b = b->super;
+        }
 }
 
 struct astnode *custom_traverse(void *param, void *(*callback)(void *, struct astnode *), struct astnode *block, enum traverse_params domain)
 {
         if (block->type != NODE_BLOCK) {
-                printf("custom_traverse(..): Block is a %s!\n", nodetype_string(block->type));
+                diagnose("custom_traverse(..): Block is a %s!\n", nodetype_string(block->type));
                 return NULL;
         }
 
@@ -59,30 +149,40 @@ struct astnode *custom_traverse(void *param, void *(*callback)(void *, struct as
         struct astnode *node;
 
         while (b != NULL) {
+                profile_steps++;
+
                 if ((node = astnode_compound_foreach((domain & TRAVERSE_SYMBOLS) ? b->block.symbols : b->block.nodes,
                                                      param, callback)))
                         return node;
 
-                if (domain & TRAVERSE_HALT_NESTED && b->holder && b->holder->type == NODE_FUNCTION_DEFINITION) {
-                        if (!(domain & TRAVERSE_GLOBAL_REGARDLESS))
-                                return NULL;
+                b = next_scope(b, domain);
+        }
 
-                        // Traverse the tree up all the way up until the global scope
-                        while (true) {
-                                if (!b->holder)
-                                        return NULL;
+        return NULL;
+}
 
-                                if (b->holder->type == NODE_PROGRAM)
-                                        break;
+struct astnode *find_symbol_advanced(char *id, struct astnode *block, enum traverse_params domain)
+{
+        if (block->type != NODE_BLOCK) {
+                diagnose("find_symbol_advanced(..): Block is a %s!\n", nodetype_string(block->type));
+                return NULL;
+        }
 
-                                if (b->super)
-                                        b = b->super;
-                        }
+        struct astnode *symbol;
 
-                        return custom_traverse(param, callback, b, domain);
-                }
+        profile_lookups++;
 
-                b = b->super;
+        for (struct astnode *b = block; b != NULL; b = next_scope(b, domain)) {
+                profile_steps++;
+
+                if (!(symbol = symtable_get(b->block.table, id)))
+                        continue;
+
+                // Declared further down the program than what is currently analyzed
+                if (!b->super && symbol->symbol.unit > current_unit)
+                        return NULL;
+
+                return symbol;
         }
 
         return NULL;
@@ -90,19 +190,18 @@ struct astnode *custom_traverse(void *param, void *(*callback)(void *, struct as
 
 struct astnode *find_symbol(char *id, struct astnode *block)
 {
-        return custom_traverse(id, (void *) filter_symbol, block,
-                               TRAVERSE_SYMBOLS | TRAVERSE_HALT_NESTED | TRAVERSE_GLOBAL_REGARDLESS);
+        return find_symbol_advanced(id, block, TRAVERSE_SYMBOLS | TRAVERSE_HALT_NESTED | TRAVERSE_GLOBAL_REGARDLESS);
 }
 
 struct astnode *find_symbol_shallow(char *id, struct astnode *block)
 {
-        return astnode_compound_foreach(block->block.symbols, id, (void *) filter_symbol);
+        return symtable_get(block->block.table, id);
 }
 
 struct astnode *find_enclosing_function(struct astnode *block)
 {
         if (block->type != NODE_BLOCK) {
-                printf("find_enclosing_function(..): Block is a %s!\n", nodetype_string(block->type));
+                diagnose("find_enclosing_function(..): Block is a %s!\n", nodetype_string(block->type));
                 return NULL;
         }
 
@@ -124,7 +223,7 @@ struct astnode *find_enclosing_function(struct astnode *block)
 struct astnode *find_uncertain_reachability_structures(struct astnode *block)
 {
         if (block->type != NODE_BLOCK) {
-                printf("find_uncertain_reachability_structures(..): Block is a %s!\n", nodetype_string(block->type));
+                diagnose("find_uncertain_reachability_structures(..): Block is a %s!\n", nodetype_string(block->type));
                 return NULL;
         }
 
@@ -145,7 +244,7 @@ struct astnode *find_uncertain_reachability_structures(struct astnode *block)
 
 static struct astnode *filter_type_field(char *id, struct astnode *field)
 {
-        if (strcmp(id, field->declaration.identifier) == 0)
+        if (field->declaration.identifier == id)
                 return field;
 
         return NULL;
@@ -164,7 +263,13 @@ struct astnode *find_in_type(struct astnode *complex, char *id)
 
 void put_symbol(struct astnode *block, struct astnode *symbol)
 {
+        if (!block->block.table)
+                block->block.table = symtable_new();
+
+        symbol->symbol.unit = current_unit;
+
         astnode_push_compound(block->block.symbols, symbol);
+        symtable_put(block->block.table, symbol);
 }
 
 _Bool is_uppermost_block(struct astnode *block)
@@ -189,7 +294,7 @@ static _Bool types_compatible_advanced(struct astdtype *destination, struct astd
         if (destination->type == ASTDTYPE_VOID)
                 return true;
 
-        if (destination->type == ASTDTYPE_COMPLEX && strcmp(destination->complex.name, source->complex.name) == 0)
+        if (destination->type == ASTDTYPE_COMPLEX && destination->complex.name == source->complex.name)
                 return true;
 
 #define XOR(a, b) (((a) && !(b)) || (!(a) && (b)))
@@ -213,11 +318,47 @@ static _Bool types_compatible_advanced(struct astdtype *destination, struct astd
         return false;
 }
 
+/**
+ * Results of types_compatible by the IDs of both types. Every entry holds both IDs (31 bits each), the result
+ * and a bit telling it is in use, so it can be read and written by any thread without further synchronization.
+ * Colliding pairs simply replace each other. Cleared by semantics_init, before any worker threads exist.
+ **/
+#define COMPATIBILITY_CACHE_SIZE 4096
+#define COMPATIBILITY_ID_LIMIT (1u << 31)
+
+static uint64_t compatibility_cache[COMPATIBILITY_CACHE_SIZE];
+
 _Bool types_compatible(struct astdtype *destination, struct astdtype *source)
 {
-        return types_compatible_advanced(destination, source, false);
+        // Most types are canonical, see struct astdtype
+        if (destination == source)
+                return true;
+
+        if (destination->id >= COMPATIBILITY_ID_LIMIT || source->id >= COMPATIBILITY_ID_LIMIT)
+                return types_compatible_advanced(destination, source, false);
+
+        uint64_t key = (uint64_t) destination->id << 31 | source->id;
+        uint64_t *slot = &compatibility_cache[(key * 0x9E3779B97F4A7C15ull >> 52) & (COMPATIBILITY_CACHE_SIZE - 1)];
+        uint64_t entry = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+        if ((entry & 1) && entry >> 2 == key)
+                return (entry >> 1) & 1;
+
+        _Bool compatible = types_compatible_advanced(destination, source, false);
+
+        __atomic_store_n(slot, key << 2 | (uint64_t) compatible << 1 | 1, __ATOMIC_RELAXED);
+
+        return compatible;
+}
+
+static void compatibility_cache_clear(void)
+{
+        memset(compatibility_cache, 0, sizeof(compatibility_cache));
 }
 
+#undef COMPATIBILITY_ID_LIMIT
+#undef COMPATIBILITY_CACHE_SIZE
+
 size_t quantify_type_size(struct astdtype *type)
 {
         if (type->type == ASTDTYPE_POINTER)
@@ -290,12 +431,6 @@ struct astdtype *required_type_integer(struct semantics *sem, int value)
         return NULL;
 }
 
-struct astdtype *semantics_new_type(struct semantics *sem, struct astdtype *type)
-{
-        astnode_push_compound(sem->stuff, astnode_data_type(type));
-        return type;
-}
-
 size_t find_pointer_degree(struct astdtype *type, struct astdtype **outType)
 {
         size_t deg = 0;
@@ -318,6 +453,11 @@ void semantics_new_function(struct semantics *sem, struct astnode *function)
         function->function_def.generated = gf;
 }
 
+void semantics_name(struct semantics *sem, struct astnode *node)
+{
+        astnode_push_compound(sem->named, node);
+}
+
 void semantics_new_include(struct semantics *sem, char *path)
 {
         struct astnode *include = astnode_include(0, NULL, path);
@@ -327,7 +467,7 @@ void semantics_new_include(struct semantics *sem, char *path)
 _Bool has_attribute(struct astnode *compound, char const *iden)
 {
         for (size_t i = 0; i < compound->node_compound.count; i++)
-                if (strcmp(compound->node_compound.array[i]->attribute.identifier, iden) == 0)
+                if (compound->node_compound.array[i]->attribute.identifier == iden)
                         return true;
 
         return false;
@@ -339,7 +479,7 @@ struct astnode *symbol_conflict(char *id, struct astnode *node)
 
         // Node: Functions may not be shadowed to avoid confusion
         if ((symbol = find_symbol(id, node->super)) && symbol->super == node->super) {
-                printf("The symbol '%s' is already defined - Redefinition attempted on line %ld. Previous definition on line %ld as a %s.\n",
+                diagnose("The symbol '%s' is already defined - Redefinition attempted on line %ld. Previous definition on line %ld as a %s.\n",
                        id, node->line, symbol->line,
                        symbol_type_humanstr(symbol->symbol.symtype));
                 return symbol;
@@ -3,6 +3,8 @@
 
 #include "../common/ast.h"
 #include "semantics.h"
+#include "../cache/cache.h"
+#include "../codegen/emit.h"
 
 struct semantics {
         struct astdtype *int8;
@@ -18,14 +20,57 @@ struct semantics {
 
         struct astnode *stuff;
 
-        size_t symbol_counter;
+        size_t symbol_counter; // Numbers globals, or the locals of the function a forked child analyzes
+
+        // Nodes waiting for their generated names, in the order they were analyzed. See semantics_join
+        struct astnode *named;
+
+        size_t threads; // Upper limit for the worker threads analyzing function bodies
+
+        // Name of the module being compiled, NULL for a program. Exported symbols are named after it
+        char *module;
+
+        char *directory; // Imports are resolved relative to this directory
+
+        struct astnode *modules; // Import nodes of all modules declared so far. Shared between forks
+
+        struct cache *cache; // Function bodies whose generated code is found here are not analyzed. May be NULL
 
         _Bool pristine; // TRUE if nothing but include nodes were analyzed up until this time
 };
 
-void semantics_init(struct semantics *, struct astnode *types, struct astnode *program);
+void semantics_init(struct semantics *, struct astnode *program);
+
+/**
+ * Set up the state for analyzing a single top-level node (possibly on another thread). Everything
+ * the analysis would add to the shared state is collected in the child instead.
+ **/
+void semantics_fork(struct semantics *parent, struct semantics *child);
 
-void semantics_free(struct semantics *);
+/**
+ * Merge the results of a forked analysis back into the parent. Generated names are handed out here:
+ * Globals are numbered by the parent, so joining the children in source order numbers them exactly like
+ * a serial analysis would. Locals of a function are numbered by its child alone, which keeps their names
+ * stable no matter what changes elsewhere in the program. A child may be joined repeatedly, each join
+ * merges what was added since the last one.
+ **/
+void semantics_join(struct semantics *parent, struct semantics *child);
+
+/**
+ * Set the top-level node the calling thread analyzes. Global symbols declared by later top-level nodes
+ * are hidden from lookups, so function bodies only see what was declared before them regardless of the
+ * order they are analyzed in. SIZE_MAX makes everything visible.
+ **/
+void semantics_enter_unit(size_t);
+
+/**
+ * Where the diagnostics of the calling thread go, NULL for standard output. Function bodies analyzed
+ * concurrently collect theirs, so they can be printed in source order regardless of which thread finished first.
+ **/
+void semantics_collect_diagnostics(struct emitter *);
+
+// Report a problem with the program. Every diagnostic of the analysis goes through here
+void diagnose(const char *, ...) __attribute__((format(printf, 1, 2)));
 
 enum traverse_params {
         TRAVERSE_SYMBOLS = (1 << 0),
@@ -40,6 +85,9 @@ enum traverse_params {
 
 struct astnode *custom_traverse(void *, void *(*)(void *, struct astnode *), struct astnode *, enum traverse_params);
 
+// Look a symbol up in the given block and the scopes enclosing it, as selected by the traversal parameters
+struct astnode *find_symbol_advanced(char *, struct astnode *, enum traverse_params);
+
 struct astnode *find_symbol(char *, struct astnode *);
 
 struct astnode *find_symbol_shallow(char *, struct astnode *);
@@ -62,14 +110,16 @@ struct astdtype *required_type(struct astdtype *, struct astdtype *);
 
 struct astdtype *required_type_integer(struct semantics *, int);
 
-struct astdtype *semantics_new_type(struct semantics *, struct astdtype *);
-
 size_t find_pointer_degree(struct astdtype *, struct astdtype **);
 
 void semantics_new_function(struct semantics *, struct astnode *);
 
+// Queue a declaration, complex type or function definition for naming
+void semantics_name(struct semantics *, struct astnode *);
+
 void semantics_new_include(struct semantics *, char *);
 
+// Attribute identifiers are interned, as is the identifier passed in
 _Bool has_attribute(struct astnode *, char const *);
 
 /**
@@ -0,0 +1,69 @@
+#include "symtable.h"
+#include "../common/profile.h"
+
+#include <stdint.h>
+
+#define SYMTABLE_INITIAL_CAPACITY 8
+
+static size_t symtable_hash(char *id)
+{
+        uintptr_t key = (uintptr_t) id;
+        return (size_t) ((key >> 4) * 0x9E3779B97F4A7C15ull);
+}
+
+static struct astnode **symtable_find_slot(struct astnode **slots, size_t capacity, char *id)
+{
+        size_t slot = symtable_hash(id) & (capacity - 1);
+
+        while (slots[slot] && slots[slot]->symbol.identifier != id)
+                slot = (slot + 1) & (capacity - 1);
+
+        return &slots[slot];
+}
+
+struct symtable *symtable_new(void)
+{
+        struct symtable *table = arena_alloc(ast_arena, sizeof(struct symtable));
+        table->capacity = SYMTABLE_INITIAL_CAPACITY;
+        table->count = 0;
+        table->slots = arena_calloc(ast_arena, table->capacity, sizeof(struct astnode *));
+        profile_allocated(MEM_SYMTABLE, sizeof(struct symtable) + table->capacity * sizeof(struct astnode *));
+        return table;
+}
+
+static void symtable_grow(struct symtable *table)
+{
+        size_t capacity = table->capacity * 2;
+        struct astnode **slots = arena_calloc(ast_arena, capacity, sizeof(struct astnode *));
+        profile_allocated(MEM_SYMTABLE, capacity * sizeof(struct astnode *));
+
+        for (size_t i = 0; i < table->capacity; i++)
+                if (table->slots[i])
+                        *symtable_find_slot(slots, capacity, table->slots[i]->symbol.identifier) = table->slots[i];
+
+        table->slots = slots;
+        table->capacity = capacity;
+}
+
+void symtable_put(struct symtable *table, struct astnode *symbol)
+{
+        // Keep the load factor below 1/2
+        if ((table->count + 1) * 2 > table->capacity)
+                symtable_grow(table);
+
+        struct astnode **slot = symtable_find_slot(table->slots, table->capacity, symbol->symbol.identifier);
+
+        if (*slot)
+                return;
+
+        *slot = symbol;
+        table->count++;
+}
+
+struct astnode *symtable_get(struct symtable *table, char *id)
+{
+        if (!table || !id)
+                return NULL;
+
+        return *symtable_find_slot(table->slots, table->capacity, id);
+}
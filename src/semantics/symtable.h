@@ -0,0 +1,24 @@
+#ifndef SYMTABLE_H
+#define SYMTABLE_H
+
+#include "../common/ast.h"
+
+/**
+ * Per-block symbol table. Symbol identifiers are interned, so the table is keyed
+ * by the identifier pointer itself. It only indexes the symbols of a single block,
+ * the block's 'symbols' compound remains the ordered record of all of them.
+ **/
+struct symtable {
+        struct astnode **slots;
+        size_t capacity; // Always a power of two
+        size_t count;
+};
+
+struct symtable *symtable_new(void);
+
+// Insert a symbol. If a symbol with the same identifier already exists, the older one is kept
+void symtable_put(struct symtable *, struct astnode *);
+
+struct astnode *symtable_get(struct symtable *, char *);
+
+#endif
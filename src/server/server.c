@@ -0,0 +1,723 @@
+#include "server.h"
+#include "../common/io.h"
+#include "../common/util.h"
+#include "../common/intern.h"
+#include "../syntax/lexer.h"
+#include "../syntax/parser.h"
+#include "../syntax/syntax.h"
+#include "../modules/module.h"
+#include "../cache/image.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <dirent.h>
+
+// Standard input, standard output and the output file of the client, passed along with every request
+#define REQUEST_FDS 3
+
+// How long no source may change before a watched project is compiled again, in milliseconds
+#define WATCH_SETTLE_TIME 50
+
+/**
+ * A source file the server has seen, along with its parsed tree. Files are identified by their canonical
+ * path (interned), so the same module reached through different relative paths is only kept once.
+ **/
+struct resident {
+        char *path;
+        uint64_t hash;
+        size_t length;
+        struct arena arena;             // The tree lives here, or in the image
+        struct ast_image image;
+        struct astnode *tree;           // NULL if the file could not be parsed
+
+        struct resident **imports;      // As far as they exist
+        size_t import_count;
+
+        uint64_t compiled_hash;         // Of the source, when the server last compiled it as a module successfully
+
+        size_t queued;                  // } The last requests the file was queued for and checked for stability in,
+        size_t checked;                 // } and the outcome of the check
+        _Bool stable;                   // }
+        _Bool visiting;
+};
+
+static struct resident **residents = NULL;
+static size_t resident_count = 0;
+static size_t resident_capacity = 0;
+
+// Numbers the requests, starting with 1
+static size_t request_number = 0;
+
+// Set in the processes compiling on behalf of the server
+static _Bool serving = false;
+
+// Where parsed trees are kept as images besides. NULL for none
+static struct cache *image_cache = NULL;
+
+static struct resident *resident_find(const char *path)
+{
+        char *canonical = realpath(path, NULL);
+
+        if (!canonical)
+                return NULL;
+
+        char *name = intern(canonical);
+        free(canonical);
+
+        for (size_t i = 0; i < resident_count; i++)
+                if (residents[i]->path == name)
+                        return residents[i];
+
+        return NULL;
+}
+
+static struct resident *resident_get(const char *path)
+{
+        struct resident *resident = resident_find(path);
+
+        if (resident)
+                return resident;
+
+        char *canonical = realpath(path, NULL);
+
+        if (!canonical)
+                return NULL;
+
+        resident = calloc(1, sizeof(struct resident));
+        resident->path = intern(canonical);
+        resident->image = empty_ast_image;
+        free(canonical);
+
+        if (resident_count == resident_capacity) {
+                resident_capacity = resident_capacity ? resident_capacity * 2 : 16;
+                residents = realloc(residents, resident_capacity * sizeof(struct resident *));
+        }
+
+        residents[resident_count++] = resident;
+        return resident;
+}
+
+static void resident_clear(struct resident *resident)
+{
+        if (resident->tree)
+                arena_free(&resident->arena);
+
+        ast_image_close(&resident->image);
+        free(resident->imports);
+
+        resident->tree = NULL;
+        resident->imports = NULL;
+        resident->import_count = 0;
+}
+
+// Find the modules a freshly parsed file imports. Those that do not exist are left to the compiler to report
+static void resident_imports(struct resident *resident)
+{
+        struct astnode *nodes = resident->tree->program.block->block.nodes;
+        char *directory = module_directory(resident->path);
+
+        resident->imports = malloc((nodes->node_compound.count + 1) * sizeof(struct resident *));
+
+        for (size_t i = 0; i < nodes->node_compound.count; i++) {
+                struct astnode *import = nodes->node_compound.array[i];
+
+                if (import->type != NODE_IMPORT)
+                        continue;
+
+                char *base = module_base(directory, import->import.path);
+                char source[strlen(base) + strlen(MODULE_SOURCE_EXTENSION) + 1];
+
+                sprintf(source, "%s%s", base, MODULE_SOURCE_EXTENSION);
+                free(base);
+
+                struct resident *module = resident_get(source);
+
+                if (module)
+                        resident->imports[resident->import_count++] = module;
+        }
+
+        free(directory);
+}
+
+// Bring the tree of a file up to date with its content. FALSE if it does not parse
+static _Bool resident_refresh(struct resident *resident)
+{
+        struct input_handle handle = empty_input_handle;
+
+        // Read rather than mapped, or an editor truncating the file meanwhile would take the server down with
+        // SIGBUS. Only the processes compiling on our behalf map sources. Missing files are reported by the compiler
+        if (!input_read_copy(resident->path, &handle)) {
+                resident_clear(resident);
+                return true;
+        }
+
+        uint64_t hash = hash_bytes(HASH_SEED, handle.buffer, handle.length);
+
+        if (resident->tree && resident->hash == hash && resident->length == handle.length) {
+                input_free(&handle);
+                return true;
+        }
+
+        resident_clear(resident);
+
+        resident->hash = hash;
+        resident->length = handle.length;
+
+        arena_init(&resident->arena, ARENA_CHUNK_SIZE);
+        ast_arena = &resident->arena;
+
+        char *image_path = image_cache ? ast_image_path(image_cache->directory, hash) : NULL;
+        struct astnode *tree = image_path ? ast_image_load(&resident->image, image_path, hash, handle.length) : NULL;
+
+        if (!tree) {
+                struct lexer lex;
+                lexer_init(&lex, &handle);
+
+                struct parser p;
+                parser_init(&p, &lex);
+
+                tree = parse(&p);
+
+                if (tree && image_path)
+                        ast_image_store(image_path, tree, hash, handle.length);
+
+                parser_free(&p);
+        }
+
+        free(image_path);
+        input_free(&handle);
+        ast_arena = NULL;
+
+        resident->tree = tree;
+
+        if (!tree) {
+                arena_free(&resident->arena);
+                return false;
+        }
+
+        resident_imports(resident);
+
+        return true;
+}
+
+static _Bool module_outputs_exist(struct resident *resident)
+{
+        size_t length = strlen(resident->path) - strlen(MODULE_SOURCE_EXTENSION);
+        char path[length + strlen(MODULE_INTERFACE_EXTENSION) + 1];
+
+        snprintf(path, sizeof(path), "%.*s%s", (int) length, resident->path, MODULE_INTERFACE_EXTENSION);
+
+        if (access(path, F_OK) != 0)
+                return false;
+
+        snprintf(path, sizeof(path), "%.*s.c", (int) length, resident->path);
+
+        return access(path, F_OK) == 0;
+}
+
+// Unchanged since its last successful compilation, and so is everything it imports
+static _Bool resident_stable(struct resident *resident)
+{
+        if (resident->visiting)
+                return false;
+
+        if (resident->checked == request_number)
+                return resident->stable;
+
+        resident->checked = request_number;
+        resident->visiting = true;
+
+        _Bool stable = resident->tree && resident->compiled_hash == resident->hash && module_outputs_exist(resident);
+
+        for (size_t i = 0; i < resident->import_count && stable; i++)
+                stable = resident_stable(resident->imports[i]);
+
+        resident->visiting = false;
+        resident->stable = stable;
+
+        return stable;
+}
+
+/**
+ * Refresh the requested file and everything it imports, directly or not, and find out which modules are
+ * stable. The files are collected into the given list (the requested one first). FALSE if any of them
+ * does not parse. The errors are printed just like the compiler would.
+ **/
+static _Bool prepare(const char *path, struct resident ***closure, size_t *count)
+{
+        *closure = NULL;
+        *count = 0;
+
+        // Standard input cannot be kept, and neither can files that do not exist
+        struct resident *root = (strcmp(path, "-") != 0) ? resident_get(path) : NULL;
+
+        if (!root)
+                return true;
+
+        size_t capacity = 16;
+        struct resident **list = malloc(capacity * sizeof(struct resident *));
+        _Bool success = true;
+
+        list[(*count)++] = root;
+        root->queued = request_number;
+
+        for (size_t i = 0; i < *count && success; i++) {
+                struct resident *resident = list[i];
+
+                if (!resident_refresh(resident)) {
+                        printf("-- Parsing failed --\n");
+
+                        if (resident != root)
+                                printf("-- Building imported modules failed --\n");
+
+                        success = false;
+                        break;
+                }
+
+                for (size_t j = 0; j < resident->import_count; j++) {
+                        struct resident *module = resident->imports[j];
+
+                        if (module->queued == request_number)
+                                continue;
+
+                        if (*count == capacity)
+                                list = realloc(list, (capacity *= 2) * sizeof(struct resident *));
+
+                        module->queued = request_number;
+                        list[(*count)++] = module;
+                }
+        }
+
+        for (size_t i = 1; i < *count && success; i++)
+                resident_stable(list[i]);
+
+        *closure = list;
+        return success;
+}
+
+static _Bool receive_request(int client, char *path, int *fds)
+{
+        char control[CMSG_SPACE(sizeof(int) * REQUEST_FDS)];
+        struct iovec data = {.iov_base = path, .iov_len = PATH_MAX};
+        struct msghdr message = {.msg_iov = &data, .msg_iovlen = 1, .msg_control = control,
+                                 .msg_controllen = sizeof(control)};
+
+        ssize_t length = recvmsg(client, &message, MSG_CMSG_CLOEXEC);
+
+        if (length <= 0)
+                return false;
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+        if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                return false;
+
+        size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(header), sizeof(int) * (received < REQUEST_FDS ? received : REQUEST_FDS));
+
+        // Whatever arrived has to be closed again if the request is malformed
+        if (received != REQUEST_FDS || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || path[length - 1] != '\0') {
+                for (size_t i = 0; i < received && i < REQUEST_FDS; i++)
+                        close(fds[i]);
+                return false;
+        }
+
+        return true;
+}
+
+// Compile a program with everything kept in memory, reading "-" from and writing the program to the given descriptors
+static _Bool build(const char *path, int input, int output, server_compiler compile)
+{
+        struct resident **closure;
+        size_t count;
+
+        request_number++;
+        _Bool success = prepare(path, &closure, &count);
+
+        if (success) {
+                fflush(stdout);
+
+                pid_t pid = fork();
+
+                if (pid == 0) {
+                        if (input != STDIN_FILENO)
+                                dup2(input, STDIN_FILENO);
+                        serving = true;
+
+                        _Bool compiled = compile(path, output);
+                        fflush(stdout);
+                        _exit(compiled ? 0 : 1);
+                }
+
+                if (pid < 0) {
+                        printf("Could not start compiling \"%s\": %s\n", path, strerror(errno));
+                        success = false;
+                } else {
+                        int status;
+
+                        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+                        success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                }
+        }
+
+        // All imported modules were either compiled or up to date. The requested file was compiled as a program
+        if (success)
+                for (size_t i = 1; i < count; i++)
+                        closure[i]->compiled_hash = closure[i]->hash;
+
+        free(closure);
+
+        return success;
+}
+
+static void serve(int client, server_compiler compile)
+{
+        char path[PATH_MAX];
+        int fds[REQUEST_FDS];
+
+        if (!receive_request(client, path, fds))
+                return;
+
+        // Everything printed while handling the request goes to the client, just like in a compiler of its own
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+
+        _Bool success = build(path, fds[0], fds[2], compile);
+
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        for (size_t i = 0; i < REQUEST_FDS; i++)
+                close(fds[i]);
+
+        char reply = success;
+        send(client, &reply, 1, MSG_NOSIGNAL);
+}
+
+_Bool server_run(const char *socket_path, struct cache *cache, server_compiler compile)
+{
+        image_cache = cache;
+
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+        if (strlen(socket_path) >= sizeof(address.sun_path)) {
+                printf("The socket path \"%s\" is too long.\n", socket_path);
+                return false;
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+        if (listener < 0) {
+                printf("Could not create the server socket: %s\n", strerror(errno));
+                return false;
+        }
+
+        // A server that went away leaves its socket behind
+        unlink(socket_path);
+
+        if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+                printf("Could not listen on \"%s\": %s\n", socket_path, strerror(errno));
+                close(listener);
+                return false;
+        }
+
+        // Clients that hang up early must not take the server down with them
+        signal(SIGPIPE, SIG_IGN);
+
+        printf("Serving compile requests on \"%s\".\n", socket_path);
+        fflush(stdout);
+
+        while (true) {
+                int client = accept(listener, NULL, NULL);
+
+                if (client < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED)
+                                continue;
+
+                        printf("Could not accept compile requests: %s\n", strerror(errno));
+                        break;
+                }
+
+                // Not to be passed on to programs started while compiling
+                fcntl(client, F_SETFD, FD_CLOEXEC);
+
+                serve(client, compile);
+                close(client);
+        }
+
+        close(listener);
+        unlink(socket_path);
+
+        return false;
+}
+
+// The directories being watched, indexed by their watch descriptors
+struct watch {
+        int fd;
+        char **directories;
+        size_t capacity;
+};
+
+// Watch a directory and everything below it, except for hidden directories like the function cache
+static void watch_tree(struct watch *watch, const char *directory)
+{
+        int wd = inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+                                                         IN_DELETE | IN_ONLYDIR);
+
+        if (wd < 0) {
+                printf("Could not watch \"%s\": %s\n", directory, strerror(errno));
+                return;
+        }
+
+        if ((size_t) wd >= watch->capacity) {
+                size_t capacity = (watch->capacity == 0) ? 16 : watch->capacity;
+                while (capacity <= (size_t) wd)
+                        capacity *= 2;
+
+                watch->directories = realloc(watch->directories, capacity * sizeof(char *));
+                memset(watch->directories + watch->capacity, 0, (capacity - watch->capacity) * sizeof(char *));
+                watch->capacity = capacity;
+        }
+
+        free(watch->directories[wd]);
+        watch->directories[wd] = strdup(directory);
+
+        DIR *dir = opendir(directory);
+
+        if (!dir)
+                return;
+
+        struct dirent *entry;
+
+        while ((entry = readdir(dir))) {
+                if (entry->d_name[0] == '.')
+                        continue;
+
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+                struct stat info;
+
+                if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && stat(path, &info) == 0 &&
+                                                S_ISDIR(info.st_mode)))
+                        watch_tree(watch, path);
+        }
+
+        closedir(dir);
+}
+
+static _Bool is_source(const char *name)
+{
+        size_t length = strlen(name);
+
+        size_t extension = strlen(MODULE_SOURCE_EXTENSION);
+
+        return length > extension && strcmp(name + length - extension, MODULE_SOURCE_EXTENSION) == 0;
+}
+
+/**
+ * Block until a source file changes. Editors tend to save in several steps and projects are often changed a few
+ * files at once, so we wait for things to settle down before reporting the change. New directories are watched
+ * as they appear.
+ **/
+static _Bool wait_for_change(struct watch *watch)
+{
+        _Bool changed = false;
+        int timeout = -1;
+
+        while (true) {
+                struct pollfd events = {.fd = watch->fd, .events = POLLIN};
+                int ready = poll(&events, 1, timeout);
+
+                if (ready < 0 && errno == EINTR)
+                        continue;
+
+                if (ready <= 0)
+                        return ready == 0;
+
+                char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+                ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+
+                if (length < 0 && errno == EINTR)
+                        continue;
+
+                if (length <= 0)
+                        return false;
+
+                struct inotify_event *event;
+
+                for (char *at = buffer; at < buffer + length; at += sizeof(struct inotify_event) + event->len) {
+                        event = (struct inotify_event *) at;
+
+                        // Events were lost, anything might have changed
+                        if (event->mask & IN_Q_OVERFLOW)
+                                changed = true;
+
+                        if (event->len == 0)
+                                continue;
+
+                        if (event->mask & IN_ISDIR) {
+                                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && event->name[0] != '.' &&
+                                    (size_t) event->wd < watch->capacity && watch->directories[event->wd]) {
+                                        char path[PATH_MAX];
+                                        snprintf(path, sizeof(path), "%s/%s", watch->directories[event->wd],
+                                                 event->name);
+                                        watch_tree(watch, path);
+                                }
+                        } else if (!(event->mask & IN_CREATE) && is_source(event->name))
+                                changed = true;
+                }
+
+                if (changed)
+                        timeout = WATCH_SETTLE_TIME;
+        }
+}
+
+_Bool server_watch(const char *directory, const char *path, const char *output, struct cache *cache,
+                   server_compiler compile)
+{
+        image_cache = cache;
+
+        struct watch watch = {.fd = inotify_init1(IN_CLOEXEC), .directories = NULL, .capacity = 0};
+
+        if (watch.fd < 0) {
+                printf("Could not watch \"%s\": %s\n", directory, strerror(errno));
+                return false;
+        }
+
+        // Before the first build, so that no change made while it is running goes unnoticed
+        watch_tree(&watch, directory);
+
+        do {
+                struct module_output file;
+
+                if (module_output_open(&file, output)) {
+                        _Bool success = build(path, STDIN_FILENO, file.fd, compile);
+
+                        if (module_output_close(&file, success) && success)
+                                printf("-- Compiled \"%s\" --\n", path);
+                }
+
+                printf("-- Watching \"%s\" for changes --\n", directory);
+                fflush(stdout);
+        } while (wait_for_change(&watch));
+
+        printf("Could not watch \"%s\": %s\n", directory, strerror(errno));
+
+        for (size_t i = 0; i < watch.capacity; i++)
+                free(watch.directories[i]);
+
+        free(watch.directories);
+        close(watch.fd);
+
+        return false;
+}
+
+_Bool server_request(const char *socket_path, const char *path, const char *output)
+{
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+        if (strlen(socket_path) >= sizeof(address.sun_path)) {
+                printf("The socket path \"%s\" is too long.\n", socket_path);
+                return false;
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        // The server has a working directory of its own
+        char *canonical = (strcmp(path, "-") != 0) ? realpath(path, NULL) : strdup(path);
+
+        if (!canonical) {
+                printf("Could not load input file \"%s\".\n", path);
+                return false;
+        }
+
+        int server = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+        if (server < 0 || connect(server, (struct sockaddr *) &address, sizeof(address)) != 0) {
+                printf("Could not connect to the server at \"%s\": %s\n", socket_path, strerror(errno));
+                if (server >= 0)
+                        close(server);
+                free(canonical);
+                return false;
+        }
+
+        // When the program is written to our standard output, everything else is printed to standard error
+        _Bool to_stdout = strcmp(output, "-") == 0;
+        struct module_output file;
+
+        if (!to_stdout && !module_output_open(&file, output)) {
+                close(server);
+                free(canonical);
+                return false;
+        }
+
+        int fds[REQUEST_FDS] = {STDIN_FILENO, to_stdout ? STDERR_FILENO : STDOUT_FILENO,
+                                to_stdout ? STDOUT_FILENO : file.fd};
+        char control[CMSG_SPACE(sizeof(fds))];
+        memset(control, 0, sizeof(control));
+
+        struct iovec data = {.iov_base = canonical, .iov_len = strlen(canonical) + 1};
+        struct msghdr message = {.msg_iov = &data, .msg_iovlen = 1, .msg_control = control,
+                                 .msg_controllen = sizeof(control)};
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+        // Anything we printed so far has to come before what the server prints
+        fflush(stdout);
+
+        char reply = 0;
+        _Bool success = sendmsg(server, &message, MSG_NOSIGNAL) >= 0 && recv(server, &reply, 1, 0) == 1 && reply;
+
+        close(server);
+        free(canonical);
+
+        if (to_stdout)
+                return success;
+
+        // The output only replaces the previous one if the compilation succeeded
+        return module_output_close(&file, success) && success;
+}
+
+struct astnode *server_tree(const char *path, uint64_t hash)
+{
+        if (!serving)
+                return NULL;
+
+        struct resident *resident = resident_find(path);
+
+        if (!resident || !resident->tree || resident->hash != hash)
+                return NULL;
+
+        return resident->tree;
+}
+
+_Bool server_unchanged(const char *path)
+{
+        if (!serving)
+                return false;
+
+        struct resident *resident = resident_find(path);
+
+        return resident && resident->checked == request_number && resident->stable;
+}
@@ -0,0 +1,46 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "../common/ast.h"
+#include "../cache/cache.h"
+
+#include <stdint.h>
+
+// Where the server listens and clients connect by default, relative to the working directory
+#define SERVER_SOCKET ".polymine-server"
+
+// Compiles the program at the given path into the given file descriptor
+typedef _Bool (*server_compiler)(const char *, int);
+
+/**
+ * Serve compile requests on a Unix domain socket until killed. Only returns if the socket cannot be set up.
+ *
+ * The parsed trees of all requested files and of the modules they import stay in memory, and are parsed again
+ * only once the content of their file changes. Imported modules are not compiled again as long as neither they
+ * nor anything they import changed since they were last compiled successfully. Requests are handled one at a
+ * time, each in a process of its own that inherits the resident trees and leaves them untouched. Trees are
+ * kept as images in the given cache as well, unless it is NULL.
+ **/
+_Bool server_run(const char *, struct cache *, server_compiler);
+
+/**
+ * Compile the program at the given path into the output file, then again whenever a source file in the given
+ * directory or below changes. Works just like the server does, so only the changed files are parsed again and
+ * only modules affected by the change are compiled and written again. Only returns if watching fails.
+ **/
+_Bool server_watch(const char *, const char *, const char *, struct cache *, server_compiler);
+
+/**
+ * Compile through a running server. Diagnostics are printed to our standard output, the generated program
+ * is written to the given path. The server reads the source from our standard input if the path is "-", and
+ * writes the program to our standard output if the output path is, printing diagnostics to standard error.
+ **/
+_Bool server_request(const char *, const char *, const char *);
+
+// The resident tree of a source with the given hash. NULL unless compiling on behalf of the server
+struct astnode *server_tree(const char *, uint64_t);
+
+// Whether the outputs of a module are still up to date. Always FALSE unless compiling on behalf of the server
+_Bool server_unchanged(const char *);
+
+#endif
@@ -1,5 +1,7 @@
 #include "lexer.h"
+#include "scan.h"
 #include "../common/defs.h"
+#include "../common/intern.h"
 
 #include <ctype.h>
 #include <stdio.h>
@@ -50,61 +52,112 @@ const char *lxtype_string(enum lxtype type)
                 AUTO_CASE(LX_DOT)
                 AUTO_CASE(LX_COMMA)
                 AUTO_CASE(LX_QUESTION_MARK)
+                AUTO_CASE(LX_KW_RESOLVE)
+                AUTO_CASE(LX_KW_NOTHING)
+                AUTO_CASE(LX_KW_VAR)
+                AUTO_CASE(LX_KW_IF)
+                AUTO_CASE(LX_KW_INCLUDE)
+                AUTO_CASE(LX_KW_IMPORT)
+                AUTO_CASE(LX_KW_PRESENT)
+                AUTO_CASE(LX_KW_TYPE)
+                AUTO_CASE(LX_KW_FN)
+                AUTO_CASE(LX_KW_TRUE)
+                AUTO_CASE(LX_KW_FALSE)
+                AUTO_CASE(LX_KW_PTR_TO)
+                AUTO_CASE(LX_KW_DEREF)
+                AUTO_CASE(LX_TYPE_VOID)
+                AUTO_CASE(LX_TYPE_CHAR)
+                AUTO_CASE(LX_TYPE_BYTE)
+                AUTO_CASE(LX_TYPE_DOUBLE)
+                AUTO_CASE(LX_TYPE_INT8)
+                AUTO_CASE(LX_TYPE_INT16)
+                AUTO_CASE(LX_TYPE_INT32)
+                AUTO_CASE(LX_TYPE_INT64)
+                AUTO_CASE(LX_TYPE_STRING)
                 default:
                         return "[??]";
         }
 #undef AUTO_CASE
 }
 
-void lexer_init(struct lexer *obj, struct input_handle const *handle)
+void lexer_init(struct lexer *obj, struct input_handle *handle)
 {
         obj->input = handle;
         obj->position = 0;
+        obj->mark = 0;
         obj->line = 1;
+
+        scan_init();
 }
 
-void lxtok_init(struct lxtok *tok, enum lxtype type, char *val, size_t line)
+void lxtok_init(struct lxtok *tok, enum lxtype type, size_t offset, size_t length, size_t line)
 {
         tok->type = type;
-        if (val)
-                tok->value = strdup(val);
-        else
-                tok->value = NULL;
+        tok->offset = offset;
+        tok->length = length;
+        tok->value = NULL;
         tok->line = line;
 }
 
 void lxtok_free(struct lxtok *tok)
 {
-        if (tok->value) {
-                free(tok->value);
-                tok->value = NULL;
-        }
-
+        // Token values are interned and thus not owned by the token
+        tok->value = NULL;
+        tok->offset = 0;
+        tok->length = 0;
         tok->line = 0;
         tok->type = LX_UNDEFINED;
 }
 
+/**
+ * Make sure that at least 'count' bytes past the current position are in the window, refilling
+ * streaming inputs as needed. 'start' is the position of a token in progress (or NULL); it is
+ * adjusted together with the lexer's own positions whenever the window moves.
+ **/
+static _Bool lexer_fill(struct lexer *lx, size_t count, size_t *start)
+{
+        while (lx->position + count > lx->input->length) {
+                size_t keep = lx->mark;
+
+                if (start && *start < keep)
+                        keep = *start;
+
+                size_t shift;
+                _Bool more = input_refill(lx->input, keep, &shift);
+
+                lx->position -= shift;
+                lx->mark -= shift;
+
+                if (start)
+                        *start -= shift;
+
+                if (!more)
+                        return false;
+        }
+
+        return true;
+}
+
 _Bool lexer_skip_spaces(struct lexer *lx)
 {
-        if (lx->position >= lx->input->length)
-                return false;
+        while (lexer_fill(lx, 1, NULL)) {
+                lx->position = scan.spaces(lx->input->buffer, lx->position, lx->input->length, &lx->line);
 
-        _Bool comment = false;
+                // Ran off the end of the window, refill and carry on
+                if (lx->position == lx->input->length)
+                        continue;
 
-        for (; lx->position < lx->input->length; lx->position++) {
-                char c = lx->input->buffer[lx->position];
+                lexer_fill(lx, 2, NULL);
 
-                if (lx->position + 1 < lx->input->length && c == '/' && lx->input->buffer[lx->position + 1] == '/') {
-                        comment = true;
-                }
+                const char *buffer = lx->input->buffer;
+                size_t length = lx->input->length;
 
-                if (c == '\n') {
-                        comment = false;
-                }
+                // Comments run until the end of the line. The newline itself is counted by the next round
+                if (lx->position + 1 < length && buffer[lx->position] == '/' && buffer[lx->position + 1] == '/') {
+                        do
+                                lx->position = scan_until(lx->input->buffer, lx->position, lx->input->length, '\n');
+                        while (lx->position == lx->input->length && lexer_fill(lx, 1, NULL));
 
-                if (isspace(c) || comment) {
-                        if (c == '\n')
-                                lx->line++;
                         continue;
                 }
 
@@ -119,108 +172,154 @@ inline _Bool lexer_empty(struct lexer *lx)
         return !lexer_skip_spaces(lx);
 }
 
-_Bool lexer_next(struct lexer *lx, struct lxtok *tok)
+struct keyword {
+        const char *name;
+        size_t length;
+        enum lxtype type;
+};
+
+/**
+ * Perfect hash over all keywords and builtin type names. The multipliers were chosen so that no two
+ * words share a slot; they have to be chosen anew whenever a word is added to the table.
+ * Every word is at least two characters long.
+ **/
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 7
+#define KEYWORD_HASH(s, len) ((8 * (unsigned char) (s)[0] + 4 * (unsigned char) (s)[1] + \
+                               (unsigned char) (s)[(len) - 1] + (len)) & (KEYWORD_TABLE_SIZE - 1))
+
+static const struct keyword keywords[KEYWORD_TABLE_SIZE] = {
+        [3] = {"present", 7, LX_KW_PRESENT},
+        [5] = {"ptr_to", 6, LX_KW_PTR_TO},
+        [7] = {"double", 6, LX_TYPE_DOUBLE},
+        [8] = {"if", 2, LX_KW_IF},
+        [9] = {"var", 3, LX_KW_VAR},
+        [12] = {"include", 7, LX_KW_INCLUDE},
+        [13] = {"type", 4, LX_KW_TYPE},
+        [14] = {"char", 4, LX_TYPE_CHAR},
+        [16] = {"resolve", 7, LX_KW_RESOLVE},
+        [17] = {"true", 4, LX_KW_TRUE},
+        [20] = {"void", 4, LX_TYPE_VOID},
+        [21] = {"string", 6, LX_TYPE_STRING},
+        [22] = {"import", 6, LX_KW_IMPORT},
+        [23] = {"int32", 5, LX_TYPE_INT32},
+        [24] = {"fn", 2, LX_KW_FN},
+        [25] = {"int64", 5, LX_TYPE_INT64},
+        [26] = {"nothing", 7, LX_KW_NOTHING},
+        [27] = {"int16", 5, LX_TYPE_INT16},
+        [28] = {"int8", 4, LX_TYPE_INT8},
+        [29] = {"byte", 4, LX_TYPE_BYTE},
+        [30] = {"false", 5, LX_KW_FALSE},
+        [31] = {"deref", 5, LX_KW_DEREF}
+};
+
+enum lxtype classify_identifier(const char *str, size_t length)
 {
-        enum lxmode mode = LMODE_NOTHING;
-        enum lxtype type = LX_UNDEFINED;
-        size_t line = lx->line;
+        if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
+                return LX_IDEN;
 
-        char *buffer = calloc(max_token_length, sizeof(char));
-        size_t buffer_idx = 0;
-
-        for (; lx->position < lx->input->length; lx->position++) {
-                char c = lx->input->buffer[lx->position];
-
-                // If this is the first character of the new token, and thus the mode
-                // is still unknown, try to determine it here
-                if (mode == LMODE_NOTHING) {
-                        if (is_iden_char(c)) {
-                                mode = LMODE_IDENTIFIER;
-                                type = LX_IDEN;
-                        } else if (is_number_char(c)) {
-                                mode = LMODE_NUMBER;
-                                type = LX_INTEGER;
-                        }
-                }
+        const struct keyword *kw = &keywords[KEYWORD_HASH(str, length)];
 
-                // The mode selection for string literals works in a different way
-                if (c == '"') {
-                        if (mode == LMODE_STRING)
-                                goto submit_token;
-                        mode = LMODE_STRING;
-                        type = LX_STRING;
-                        continue; // The '"' character does not constitute a part of the string
-                }
+        if (kw->length == length && memcmp(kw->name, str, length) == 0)
+                return kw->type;
 
-                // The tokenizer should be in some known state by now. If it's not the case,
-                // try to parse a special construct
-                if (mode == LMODE_NOTHING) {
-                        if (special_constr(lx, tok)) {
-                                goto free_and_exit;
-                        }
+        return LX_IDEN;
+}
 
-                        // We'll just ignore wrong tokens (for now ..)
-                        DEBUG({
-                                      printf("Unknown token starting with \"%c\" on line %ld.\n",
-                                             lx->input->buffer[lx->position], lx->line);
-                              });
+#undef KEYWORD_HASH
 
-                        lx->position++;
-                        goto reset_start_over;
-                }
+static void lexer_submit(struct lexer *lx, struct lxtok *tok, enum lxtype type, size_t start, size_t line)
+{
+        size_t length = lx->position - start;
 
-                if (mode == LMODE_IDENTIFIER) {
-                        if (!is_iden_char(c) && (!is_number_char(c) && buffer_idx > 0)) {
-                                lx->position--;
-                                goto submit_token;
-                        }
+        if (type == LX_IDEN)
+                type = classify_identifier(lx->input->buffer + start, length);
+
+        lx->mark = start;
+        lxtok_init(tok, type, lx->input->base + start, length, line);
+
+        // Identifiers are needed by pretty much every consumer, so they are interned right away
+        if (type == LX_IDEN)
+                tok->value = intern_n(lx->input->buffer + start, length);
+}
+
+/**
+ * Every scanning loop below re-reads the buffer after a refill: Streaming inputs may move or grow
+ * their window while a token is being scanned. For complete inputs, the refill just fails.
+ **/
+_Bool lexer_next(struct lexer *lx, struct lxtok *tok)
+{
+        while (lexer_fill(lx, 1, NULL)) {
+                size_t start = lx->position;
+                size_t line = lx->line;
+                char c = lx->input->buffer[start];
+
+                if (is_iden_char(c)) {
+                        do
+                                lx->position = scan.identifier(lx->input->buffer, lx->position, lx->input->length);
+                        while (lx->position == lx->input->length && lexer_fill(lx, 1, &start));
+
+                        lexer_submit(lx, tok, LX_IDEN, start, line);
+                        return true;
                 }
 
-                if (mode == LMODE_NUMBER || mode == LMODE_DECIMAL) {
-                        if (!is_number_char(c)) {
-                                if (c != '.' || mode != LMODE_NUMBER) {
-                                        lx->position--;
-                                        goto submit_token;
-                                }
+                if (is_number_char(c)) {
+                        enum lxtype type = LX_INTEGER;
+
+                        do
+                                lx->position = scan.digits(lx->input->buffer, lx->position, lx->input->length);
+                        while (lx->position == lx->input->length && lexer_fill(lx, 1, &start));
 
-                                mode = LMODE_DECIMAL;
+                        // A single decimal point turns the integer into a decimal
+                        if (lexer_fill(lx, 1, &start) && lx->input->buffer[lx->position] == '.') {
                                 type = LX_DECIMAL;
+                                lx->position++;
+
+                                do
+                                        lx->position = scan.digits(lx->input->buffer, lx->position,
+                                                                   lx->input->length);
+                                while (lx->position == lx->input->length && lexer_fill(lx, 1, &start));
                         }
+
+                        lexer_submit(lx, tok, type, start, line);
+                        return true;
                 }
 
-                buffer[buffer_idx++] = c;
+                // The '"' characters do not constitute a part of the string
+                if (c == '"') {
+                        start = ++lx->position;
 
-                if (lx->position + 1 >= lx->input->length)
-                        goto submit_token;
+                        do
+                                lx->position = scan_until(lx->input->buffer, lx->position, lx->input->length, '"');
+                        while (lx->position == lx->input->length && lexer_fill(lx, 1, &start));
 
-                continue;
+                        lexer_submit(lx, tok, LX_STRING, start, line);
 
-                reset_start_over:
-                mode = LMODE_NOTHING;
-                type = LX_UNDEFINED;
-                memset(buffer, 0, max_token_length);
-                buffer_idx = 0;
+                        if (lx->position < lx->input->length)
+                                lx->position++;
 
-                if (!lexer_skip_spaces(lx))
-                        goto free_and_exit;
+                        return true;
+                }
 
-                line = lx->line;
+                // Compound constructs are up to two characters long
+                lexer_fill(lx, 2, NULL);
 
-                // Continuing the loop will result in lx->position being incremented. The skip spaces method above skipped
-                // all the spaces, thus the position is currently pointing to the first non-space character of the next token.
-                // Therefore, we need to subtract 1 from said pointer to avoid cutting of (part) of the token
-                lx->position--;
+                if (special_constr(lx, tok))
+                        return true;
 
-        } // End of for loop
+                // We'll just ignore wrong tokens (for now ..)
+                DEBUG({
+                              printf("Unknown token starting with \"%c\" on line %ld.\n", c, lx->line);
+                      });
 
-        return true;
+                lx->position++;
 
-        submit_token:
-        lxtok_init(tok, type, buffer, line);
-        lx->position++;
+                if (!lexer_skip_spaces(lx))
+                        break;
+        }
 
-        free_and_exit:
-        free(buffer);
+        lxtok_init(tok, LX_UNDEFINED, lx->input->base + lx->position, 0, lx->line);
         return true;
 }
 
@@ -241,6 +340,7 @@ _Bool special_constr(struct lexer *lx, struct lxtok *tok)
                 c2 = '\0';
 
         char str[] = {c1, c2, 0};
+        size_t start = lx->position;
 
 #define SUBMIT_TYPE_ON(cmpstr, t)                \
         if (strcmp(str, cmpstr) == 0) {                \
@@ -311,7 +411,8 @@ _Bool special_constr(struct lexer *lx, struct lxtok *tok)
         else
                 lx->position++;
 
-        lxtok_init(tok, type, str, line);
+        lx->mark = start;
+        lxtok_init(tok, type, lx->input->base + start, lx->position - start, line);
         return true;
 }
 
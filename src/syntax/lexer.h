@@ -7,8 +7,6 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-const static size_t max_token_length = 100;
-
 enum lxtype : uint8_t {
         LX_UNDEFINED = 0,
 
@@ -54,18 +52,52 @@ enum lxtype : uint8_t {
         LX_AT,
         LX_EXCLAMATION,
         LX_DOT,
-        LX_COMMA
+        LX_COMMA,
+
+        // Keywords, followed by the builtin type names. Both have to stay last, see parser_name
+        LX_KW_RESOLVE,
+        LX_KW_NOTHING,
+        LX_KW_VAR,
+        LX_KW_IF,
+        LX_KW_INCLUDE,
+        LX_KW_IMPORT,
+        LX_KW_PRESENT,
+        LX_KW_TYPE,
+        LX_KW_FN,
+        LX_KW_TRUE,
+        LX_KW_FALSE,
+        LX_KW_PTR_TO,
+        LX_KW_DEREF,
+
+        // Builtin type names
+        LX_TYPE_VOID,
+        LX_TYPE_CHAR,
+        LX_TYPE_BYTE,
+        LX_TYPE_DOUBLE,
+        LX_TYPE_INT8,
+        LX_TYPE_INT16,
+        LX_TYPE_INT32,
+        LX_TYPE_INT64,
+        LX_TYPE_STRING
 };
 
 const char *lxtype_string(enum lxtype);
 
+/**
+ * A token is a view into the input buffer. Only identifiers carry a materialized
+ * (interned) value, everything else is read from the buffer when needed.
+ * The offset counts from the start of the input. For streaming inputs, only the text of the
+ * last two tokens is guaranteed to still be in the window (see struct lexer).
+ **/
 struct lxtok {
         enum lxtype type;
-        char *value;
+        size_t offset;
+        size_t length;
+        char *value; // Interned. Identifiers only (not keywords), NULL otherwise
         size_t line;
 };
 
-void lxtok_init(struct lxtok *, enum lxtype, char *, size_t);
+void lxtok_init(struct lxtok *, enum lxtype, size_t, size_t, size_t);
 
 void lxtok_free(struct lxtok *);
 
@@ -81,13 +113,19 @@ enum lxmode : uint8_t {
         LMODE_SPECIAL
 };
 
+/**
+ * 'position' and 'mark' are relative to the input window, see struct input_handle.
+ * 'mark' is where the previously returned token starts. Refills never discard anything
+ * past the mark, so the parser may look at the text of its current and next token.
+ **/
 struct lexer {
-        struct input_handle const *input;
+        struct input_handle *input;
         size_t position;
+        size_t mark;
         size_t line;
 };
 
-void lexer_init(struct lexer *, struct input_handle const *);
+void lexer_init(struct lexer *, struct input_handle *);
 
 _Bool lexer_skip_spaces(struct lexer *);
 
@@ -97,6 +135,8 @@ _Bool lexer_next(struct lexer *, struct lxtok *);
 
 _Bool special_constr(struct lexer *, struct lxtok *);
 
+enum lxtype classify_identifier(const char *, size_t);
+
 _Bool is_iden_char(char);
 
 _Bool is_number_char(char);
@@ -1,5 +1,8 @@
 #include "parser.h"
 #include "lexer.h"
+#include "../common/intern.h"
+#include "../common/util.h"
+#include "../common/profile.h"
 
 #include <string.h>
 
@@ -9,10 +12,13 @@ void parser_init(struct parser *p, struct lexer *lx)
         p->line = 1;
         p->block = NULL;
 
-        p->types = astnode_empty_compound(0, NULL);
+        p->references = NULL;
+        p->reference_count = 0;
+        p->reference_capacity = 0;
+        parser_record(p);
 
-        lxtok_init(&p->current, LX_UNDEFINED, NULL, 1);
-        lxtok_init(&p->next, LX_UNDEFINED, NULL, 1);
+        lxtok_init(&p->current, LX_UNDEFINED, 0, 0, 1);
+        lxtok_init(&p->next, LX_UNDEFINED, 0, 0, 1);
 
         parser_advance(p);
         parser_advance(p);
@@ -22,12 +28,40 @@ void parser_free(struct parser *p)
 {
         lxtok_free(&p->current);
         lxtok_free(&p->next);
-        freeDataTypes = true;
-        astnode_free_compound(p->types);
+        free(p->references);
+}
+
+void parser_record(struct parser *p)
+{
+        p->digest = HASH_SEED;
+        p->reference_count = 0;
+}
+
+// Fold the current token into the digest. Its text is still in the input window at this point
+static void parser_digest(struct parser *p)
+{
+        if (p->current.type == LX_UNDEFINED)
+                return;
+
+        uint8_t type = p->current.type;
+
+        p->digest = hash_bytes(p->digest, &type, sizeof(type));
+        p->digest = hash_bytes(p->digest, TOKEN_START(p, p->current), p->current.length);
+
+        if (p->current.type != LX_IDEN)
+                return;
+
+        if (p->reference_count == p->reference_capacity) {
+                p->reference_capacity = p->reference_capacity ? p->reference_capacity * 2 : 64;
+                p->references = realloc(p->references, p->reference_capacity * sizeof(char *));
+        }
+
+        p->references[p->reference_count++] = p->current.value;
 }
 
 void parser_advance(struct parser *p)
 {
+        parser_digest(p);
         lxtok_free(&p->current);
         p->current = p->next;
 
@@ -35,9 +69,27 @@ void parser_advance(struct parser *p)
                 p->line = p->current.line;
 
         if (lexer_empty(p->lx)) {
-                lxtok_init(&p->next, LX_UNDEFINED, NULL, 0);
+                lxtok_init(&p->next, LX_UNDEFINED, 0, 0, 0);
                 return;
         }
 
         lexer_next(p->lx, &p->next);
-}
\ No newline at end of file
+}
+
+_Bool parser_name(struct parser *p)
+{
+        if (p->current.type >= LX_KW_RESOLVE && p->current.type <= LX_TYPE_STRING) {
+                p->current.type = LX_IDEN;
+                p->current.value = intern_n(TOKEN_START(p, p->current), p->current.length);
+        }
+
+        return p->current.type == LX_IDEN;
+}
+
+char *parser_token_string(struct parser *p)
+{
+        if (p->current.value)
+                return p->current.value;
+
+        return intern_n(TOKEN_START(p, p->current), p->current.length);
+}
@@ -11,11 +11,13 @@ struct parser {
         struct lexer *lx;
         struct astnode *block;
 
-        // A compound node. This starts off as a way for the parser to store the data
-        // types it creates (parses), but is later repurposed by the semantic analysis stage
-        // as well as the code generators for storing lambda (ordering) as well as types.
-        struct astnode *types;
         size_t line;
+
+        // Digest of the tokens consumed since parser_record, along with the identifiers among them
+        uint64_t digest;
+        char **references;
+        size_t reference_count;
+        size_t reference_capacity;
 };
 
 // This basically tells us where we need to display the error message.
@@ -27,10 +29,32 @@ enum pstatus {
         PARSER_SYNTAX_ERROR
 };
 
+// The source text of a token. Tokens are views into the input buffer and are not NUL-terminated
+#ifndef TOKEN_START
+#define TOKEN_START(p, tok) ((p)->lx->input->buffer + ((tok).offset - (p)->lx->input->base))
+#endif
+
+// printf arguments for a token's source text, to be used with "%.*s"
+#ifndef TOKEN_TEXT
+#define TOKEN_TEXT(p, tok) (int) (tok).length, TOKEN_START(p, tok)
+#endif
+
 void parser_init(struct parser *, struct lexer *);
 
 void parser_free(struct parser *);
 
 void parser_advance(struct parser *);
 
+// Start a new digest. Only top-level nodes are recorded, to tell which ones changed between builds
+void parser_record(struct parser *);
+
+// Materialize the current token's text as an interned string
+char *parser_token_string(struct parser *);
+
+/**
+ * Whether the current token can be a name. Keywords and builtin type names only mean something where a
+ * statement, type or expression starts, and are turned into plain identifiers anywhere a name is expected.
+ **/
+_Bool parser_name(struct parser *);
+
 #endif
@@ -0,0 +1,245 @@
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static inline _Bool is_space(char c)
+{
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline _Bool is_identifier(char c)
+{
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline _Bool is_digit(char c)
+{
+        return c >= '0' && c <= '9';
+}
+
+// -- Scalar --
+
+static size_t scalar_spaces(const char *buffer, size_t position, size_t length, size_t *lines)
+{
+        for (; position < length && is_space(buffer[position]); position++)
+                if (buffer[position] == '\n')
+                        (*lines)++;
+
+        return position;
+}
+
+static size_t scalar_identifier(const char *buffer, size_t position, size_t length)
+{
+        while (position < length && is_identifier(buffer[position]))
+                position++;
+
+        return position;
+}
+
+static size_t scalar_digits(const char *buffer, size_t position, size_t length)
+{
+        while (position < length && is_digit(buffer[position]))
+                position++;
+
+        return position;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * Both vector widths share the same algorithm: Build a mask of the bytes that belong to the run,
+ * invert it and find the lowest set bit, which is the first byte that ends the run.
+ * Byte ranges are tested with an unsigned compare emulated on top of the signed one:
+ * lo <= c <= hi  <=>  ((c - lo) ^ 0x80) < ((hi - lo + 1) ^ 0x80) as signed bytes.
+ */
+
+// -- SSE2 --
+
+#define SSE2_IN_RANGE(v, lo, hi) \
+        _mm_cmplt_epi8(_mm_xor_si128(_mm_sub_epi8((v), _mm_set1_epi8(lo)), _mm_set1_epi8((char) 0x80)), \
+                       _mm_set1_epi8((char) (((hi) - (lo) + 1) ^ 0x80)))
+
+__attribute__((target("sse2")))
+static size_t sse2_spaces(const char *buffer, size_t position, size_t length, size_t *lines)
+{
+        while (position + 16 <= length) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (buffer + position));
+
+                __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), SSE2_IN_RANGE(v, '\t', '\r'));
+                unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+                unsigned end = ~_mm_movemask_epi8(space) & 0xFFFF;
+
+                if (end) {
+                        unsigned offset = __builtin_ctz(end);
+                        *lines += __builtin_popcount(newlines & ((1u << offset) - 1));
+                        return position + offset;
+                }
+
+                *lines += __builtin_popcount(newlines);
+                position += 16;
+        }
+
+        return scalar_spaces(buffer, position, length, lines);
+}
+
+__attribute__((target("sse2")))
+static size_t sse2_identifier(const char *buffer, size_t position, size_t length)
+{
+        while (position + 16 <= length) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (buffer + position));
+
+                // Folding the case bit maps 'A'-'Z' onto 'a'-'z'
+                __m128i letter = SSE2_IN_RANGE(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+                __m128i digit = SSE2_IN_RANGE(v, '0', '9');
+                __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+
+                unsigned end = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)) & 0xFFFF;
+
+                if (end)
+                        return position + __builtin_ctz(end);
+
+                position += 16;
+        }
+
+        return scalar_identifier(buffer, position, length);
+}
+
+__attribute__((target("sse2")))
+static size_t sse2_digits(const char *buffer, size_t position, size_t length)
+{
+        while (position + 16 <= length) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (buffer + position));
+                unsigned end = ~_mm_movemask_epi8(SSE2_IN_RANGE(v, '0', '9')) & 0xFFFF;
+
+                if (end)
+                        return position + __builtin_ctz(end);
+
+                position += 16;
+        }
+
+        return scalar_digits(buffer, position, length);
+}
+
+#undef SSE2_IN_RANGE
+
+// -- AVX2 --
+
+#define AVX2_IN_RANGE(v, lo, hi) \
+        _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (((hi) - (lo) + 1) ^ 0x80)), \
+                          _mm256_xor_si256(_mm256_sub_epi8((v), _mm256_set1_epi8(lo)), _mm256_set1_epi8((char) 0x80)))
+
+__attribute__((target("avx2,popcnt")))
+static size_t avx2_spaces(const char *buffer, size_t position, size_t length, size_t *lines)
+{
+        while (position + 32 <= length) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (buffer + position));
+
+                __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                                AVX2_IN_RANGE(v, '\t', '\r'));
+                unsigned newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+                unsigned end = ~(unsigned) _mm256_movemask_epi8(space);
+
+                if (end) {
+                        unsigned offset = __builtin_ctz(end);
+                        *lines += __builtin_popcount(newlines & ((1u << offset) - 1));
+                        return position + offset;
+                }
+
+                *lines += __builtin_popcount(newlines);
+                position += 32;
+        }
+
+        return sse2_spaces(buffer, position, length, lines);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_identifier(const char *buffer, size_t position, size_t length)
+{
+        while (position + 32 <= length) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (buffer + position));
+
+                __m256i letter = AVX2_IN_RANGE(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+                __m256i digit = AVX2_IN_RANGE(v, '0', '9');
+                __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+
+                unsigned end = ~(unsigned) _mm256_movemask_epi8(
+                        _mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+
+                if (end)
+                        return position + __builtin_ctz(end);
+
+                position += 32;
+        }
+
+        return sse2_identifier(buffer, position, length);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_digits(const char *buffer, size_t position, size_t length)
+{
+        while (position + 32 <= length) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (buffer + position));
+                unsigned end = ~(unsigned) _mm256_movemask_epi8(AVX2_IN_RANGE(v, '0', '9'));
+
+                if (end)
+                        return position + __builtin_ctz(end);
+
+                position += 32;
+        }
+
+        return sse2_digits(buffer, position, length);
+}
+
+#undef AVX2_IN_RANGE
+
+#endif
+
+struct scanner scan = {
+        .name = "scalar",
+        .spaces = scalar_spaces,
+        .identifier = scalar_identifier,
+        .digits = scalar_digits
+};
+
+void scan_init(void)
+{
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2")) {
+                scan = (struct scanner) {
+                        .name = "avx2",
+                        .spaces = avx2_spaces,
+                        .identifier = avx2_identifier,
+                        .digits = avx2_digits
+                };
+                return;
+        }
+
+        if (__builtin_cpu_supports("sse2")) {
+                scan = (struct scanner) {
+                        .name = "sse2",
+                        .spaces = sse2_spaces,
+                        .identifier = sse2_identifier,
+                        .digits = sse2_digits
+                };
+                return;
+        }
+#endif
+}
+
+size_t scan_until(const char *buffer, size_t position, size_t length, char c)
+{
+        if (position >= length)
+                return length;
+
+        // The C library's memchr is vectorized on every platform we care about
+        const char *found = memchr(buffer + position, c, length - position);
+
+        return found ? (size_t) (found - buffer) : length;
+}
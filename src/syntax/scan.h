@@ -0,0 +1,32 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdlib.h>
+
+/**
+ * Character class scanners used by the lexer. Each one starts at the given position
+ * and returns the position of the first character that is not part of the run (or the
+ * length of the buffer). The implementation is picked once at runtime: AVX2 or SSE2 on
+ * x86 processors that support them, plain scalar loops everywhere else.
+ **/
+struct scanner {
+        const char *name;
+
+        // Whitespace. Newlines passed along the way are added to the counter
+        size_t (*spaces)(const char *, size_t, size_t, size_t *);
+
+        // Identifier characters: [A-Za-z0-9_]
+        size_t (*identifier)(const char *, size_t, size_t);
+
+        // Decimal digits
+        size_t (*digits)(const char *, size_t, size_t);
+};
+
+extern struct scanner scan;
+
+void scan_init(void);
+
+// Position of the next occurrence of the given character, or the length of the buffer
+size_t scan_until(const char *, size_t, size_t, char);
+
+#endif
@@ -5,6 +5,8 @@
 #include "parser.h"
 #include "syntax.h"
 #include "../common/util.h"
+#include "../common/intern.h"
+#include "../common/profile.h"
 #include "../semantics/semutil.h"
 
 #include <string.h>
@@ -15,10 +17,8 @@ struct astnode *parse(struct parser *p)
 
         program->program.block = parse_block_advanced(p, false);
 
-        if (!program->program.block) {
-                free(program);
+        if (!program->program.block)
                 return NULL;
-        }
 
         program->program.block->holder = program;
 
@@ -46,35 +46,31 @@ static struct astnode *parser_parse_whatever(struct parser *p, enum pstatus *sta
         if (p->current.type == LX_STRING)
                 return parse_string_literal(p);
 
-        if (p->current.type == LX_IDEN) {
-                if (strcmp(p->current.value, "resolve") == 0)
+        switch (p->current.type) {
+                case LX_KW_RESOLVE:
                         return parse_resolve(p);
-
-                if (strcmp(p->current.value, "nothing") == 0)
+                case LX_KW_NOTHING:
                         return parse_nothing(p);
-
-                if (strcmp(p->current.value, "var") == 0)
+                case LX_KW_VAR:
                         return parse_variable_declaration(p);
-
-                if (strcmp(p->current.value, "if") == 0)
+                case LX_KW_IF:
                         return parse_if(p);
-
-                if (strcmp(p->current.value, "include") == 0)
+                case LX_KW_INCLUDE:
                         return parse_include(p);
-
-                if (strcmp(p->current.value, "present") == 0)
+                case LX_KW_IMPORT:
+                        return parse_import(p);
+                case LX_KW_PRESENT:
                         return parse_present(p);
-
-                if (strcmp(p->current.value, "type") == 0)
+                case LX_KW_TYPE:
                         return parse_type_definition(p);
-
-                if (strcmp(p->current.value, "fn") == 0)
+                case LX_KW_FN:
                         return parse_function_definition(p);
+                case LX_LBRACE:
+                        return parse_block(p);
+                default:
+                        break;
         }
 
-        if (p->current.type == LX_LBRACE)
-                return parse_block(p);
-
         struct astnode *expr = parse_expr(p);
 
         if (!expr)
@@ -86,10 +82,8 @@ static struct astnode *parser_parse_whatever(struct parser *p, enum pstatus *sta
 
                 struct astnode *value = parse_expr(p);
 
-                if (!value) {
-                        astnode_free(expr);
+                if (!value)
                         return NULL;
-                }
 
                 return astnode_assignment(expr->line, p->block, expr, value);
         }
@@ -101,12 +95,31 @@ static struct astnode *parser_parse_whatever(struct parser *p, enum pstatus *sta
         return NULL;
 }
 
+// Hand the digest of a top-level node over to the node. Functions also keep the identifiers they mention
+static void attach_digest(struct parser *p, struct astnode *node)
+{
+        switch (node->type) {
+                case NODE_COMPLEX_TYPE:
+                        node->type_definition.digest = p->digest;
+                        break;
+                case NODE_FUNCTION_DEFINITION:
+                        node->function_def.digest = p->digest;
+                        node->function_def.reference_count = p->reference_count;
+                        node->function_def.references = arena_alloc(ast_arena, p->reference_count * sizeof(char *));
+                        memcpy(node->function_def.references, p->references, p->reference_count * sizeof(char *));
+                        profile_allocated(MEM_REFERENCES, p->reference_count * sizeof(char *));
+                        break;
+                default:
+                        break;
+        }
+}
+
 struct astnode *parse_block_very_advanced(struct parser *p, _Bool decorated, struct astnode *block)
 {
         if (decorated) {
                 if (p->current.type != LX_LBRACE) {
-                        printf("Expected '{' at the beginning of a block. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
+                        printf("Expected '{' at the beginning of a block. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -126,22 +139,29 @@ struct astnode *parse_block_very_advanced(struct parser *p, _Bool decorated, str
                 if (decorated && p->current.type == LX_RBRACE)
                         break;
 
+                // Undecorated blocks are the top level of a file
+                if (!decorated)
+                        parser_record(p);
+
                 node = parser_parse_whatever(p, &status);
 
                 if (!node) {
                         if (status != PARSER_SYNTAX_ERROR)
-                                printf("Could not parse element starting with %s (\"%s\").\n",
-                                       lxtype_string(p->current.type), p->current.value);
+                                printf("Could not parse element starting with %s (\"%.*s\").\n",
+                                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current));
                         goto syntax_error;
                 }
 
+                if (!decorated)
+                        attach_digest(p, node);
+
                 astnode_push_compound(block->block.nodes, node);
         }
 
         if (decorated) {
                 if (p->current.type != LX_RBRACE) {
-                        printf("Expected '}' at the end of a block statement. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
+                        printf("Expected '}' at the end of a block statement. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -163,10 +183,8 @@ struct astnode *parse_block_very_advanced(struct parser *p, _Bool decorated, str
 struct astnode *parse_block_advanced(struct parser *p, _Bool decorated)
 {
         struct astnode *block = astnode_empty_block(p->line, p->block);
-        if (!parse_block_very_advanced(p, decorated, block)) {
-                astnode_free(block);
+        if (!parse_block_very_advanced(p, decorated, block))
                 return NULL;
-        }
         return block;
 }
 
@@ -177,9 +195,9 @@ inline struct astnode *parse_block(struct parser *p)
 
 struct astnode *parse_nothing(struct parser *p)
 {
-        if (p->current.type != LX_IDEN) {
-                printf("Expected a nothing-identifier. Got %s (\"%s\") on line %ld.\n", lxtype_string(p->current.type),
-                       p->current.value, p->line);
+        if (p->current.type != LX_KW_NOTHING) {
+                printf("Expected a nothing-identifier. Got %s (\"%.*s\") on line %ld.\n", lxtype_string(p->current.type),
+                       TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -192,43 +210,37 @@ struct astnode *parse_nothing(struct parser *p)
 
 struct astnode *parse_type_definition(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || (strcmp(p->current.value, "type") != 0)) {
-                printf("Expected 'type' identifier at the start of a type definition. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_TYPE) {
+                printf("Expected 'type' identifier at the start of a type definition. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
         parser_advance(p);
 
-        if (p->current.type != LX_IDEN) {
-                printf("Expected type identifier after 'type' keyword. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (!parser_name(p)) {
+                printf("Expected type identifier after 'type' keyword. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        char *id = strdup(p->current.value);
+        char *id = p->current.value;
 
         parser_advance(p);
 
         struct astnode *fields = parse_parameters(p, true);
 
-        if (!fields) {
-                free(id);
+        if (!fields)
                 return NULL;
-        }
-
-        struct astnode *def = astnode_type_definition(p->line, p->block, id, fields);;
 
-        free(id);
-
-        return def;
+        return astnode_type_definition(p->line, p->block, id, fields);
 }
 
 struct astnode *parse_variable_declaration(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || (p->current.type == LX_IDEN && strcmp(p->current.value, "var") != 0)) {
-                printf("Expected 'var' at the beginning of a variable declaration. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_VAR) {
+                printf("Expected 'var' at the beginning of a variable declaration. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -237,18 +249,18 @@ struct astnode *parse_variable_declaration(struct parser *p)
 
         parser_advance(p);
 
-        if (p->current.type == LX_IDEN && strcmp(p->current.value, "stable") == 0) {
+        if (p->current.type == LX_IDEN && p->current.value == NAME(STABLE)) {
                 constant = true;
                 parser_advance(p);
         }
 
-        if (p->current.type != LX_IDEN) {
-                printf("Expected variable identifier. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (!parser_name(p)) {
+                printf("Expected variable identifier. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        char *id = strdup(p->current.value);
+        char *id = p->current.value;
 
         parser_advance(p);
 
@@ -260,10 +272,8 @@ struct astnode *parse_variable_declaration(struct parser *p)
                 if (p->current.type != LX_QUESTION_MARK) {
                         type = parse_type(p);
 
-                        if (!type) {
-                                free(id);
+                        if (!type)
                                 return NULL;
-                        }
                 } else
                         parser_advance(p);
         }
@@ -275,10 +285,8 @@ struct astnode *parse_variable_declaration(struct parser *p)
 
                 expr = parse_expr(p);
 
-                if (!expr) {
-                        free(id);
+                if (!expr)
                         return NULL;
-                }
         }
 
         struct astnode *decl = astnode_declaration(line, p->block, constant, id, type, expr);
@@ -286,15 +294,14 @@ struct astnode *parse_variable_declaration(struct parser *p)
         if (decl->declaration.value)
                 decl->declaration.value->holder = decl;
 
-        free(id);
         return decl;
 }
 
 struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
 {
         if (p->current.type != LX_LPAREN) {
-                printf("Expected '(' at the beginning of a parameter list. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+                printf("Expected '(' at the beginning of a parameter list. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -309,22 +316,19 @@ struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
                 char *id;
                 struct astdtype *type;
 
-                if (p->current.type != LX_IDEN) {
-                        printf("Expected parameter identifier. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        astnode_free(params);
+                if (!parser_name(p)) {
+                        printf("Expected parameter identifier. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
-                id = strdup(p->current.value);
+                id = p->current.value;
 
                 parser_advance(p);
 
                 if (p->current.type != LX_COLON) {
-                        printf("Expected ':' after parameter identifier. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        free(id);
-                        astnode_free(params);
+                        printf("Expected ':' after parameter identifier. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -332,20 +336,15 @@ struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
 
                 type = parse_type(p);
 
-                if (!type) {
-                        free(id);
-                        astnode_free(params);
+                if (!type)
                         return NULL;
-                }
 
                 struct astnode *value = NULL;
 
-                if (p->current.type == LX_IDEN && strcmp(p->current.value, "default") == 0) {
+                if (p->current.type == LX_IDEN && p->current.value == NAME(DEFAULT)) {
                         if (!defaultValues) {
                                 printf("Default values are not allowed in a parameter list in this context. Error on line %ld.\n",
                                        p->line);
-                                free(id);
-                                astnode_free(params);
                                 return NULL;
                         }
 
@@ -353,26 +352,20 @@ struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
 
                         value = parse_expr(p);
 
-                        if (!value) {
-                                free(id);
-                                astnode_free(params);
+                        if (!value)
                                 return NULL;
-                        }
                 }
 
                 struct astnode *declaration = astnode_declaration(p->line, p->block, false, id, type, value);
                 declaration->holder = params;
                 astnode_push_compound(params, declaration);
 
-                free(id);
-
                 if (p->current.type == LX_RPAREN)
                         break;
 
                 if (p->current.type != LX_COMMA && p->next.type != LX_RPAREN) {
-                        printf("Expected ')' at the end of parameter list, or ',' and more parameters. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        astnode_free(params);
+                        printf("Expected ')' at the end of parameter list, or ',' and more parameters. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -380,9 +373,8 @@ struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
         }
 
         if (p->current.type != LX_RPAREN) {
-                printf("Expected ')' after parameter list. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                astnode_free(params);
+                printf("Expected ')' after parameter list. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -393,9 +385,9 @@ struct astnode *parse_parameters(struct parser *p, _Bool defaultValues)
 
 struct astnode *parse_function_definition(struct parser *p)
 {
-        if (p->current.type != LX_IDEN) {
-                printf("Expected 'fn' keyword at the start of a function definition. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_FN) {
+                printf("Expected 'fn' keyword at the start of a function definition. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -414,13 +406,13 @@ struct astnode *parse_function_definition(struct parser *p)
         if (!attrs)
                 attrs = astnode_empty_compound(p->line, p->block);
 
-        if (p->current.type != LX_IDEN) {
-                printf("Expected function identifier after 'fn' keyword. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (!parser_name(p)) {
+                printf("Expected function identifier after 'fn' keyword. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        char *id = strdup(p->current.value);
+        char *id = p->current.value;
 
         parser_advance(p);
 
@@ -428,20 +420,14 @@ struct astnode *parse_function_definition(struct parser *p)
 
         if (p->current.type == LX_LPAREN) {
                 params = parse_parameters(p, false);
-                if (!params) {
-                        free(id);
-                        astnode_free(attrs);
+                if (!params)
                         return NULL;
-                }
         } else
                 params = astnode_empty_compound(p->line, p->block);
 
         if (p->current.type != LX_MOV_RIGHT) {
-                printf("Expected '->' after function parameter block. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                free(id);
-                astnode_free(attrs);
-                astnode_free(params);
+                printf("Expected '->' after function parameter block. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -449,12 +435,8 @@ struct astnode *parse_function_definition(struct parser *p)
 
         struct astdtype *type = parse_type(p);
 
-        if (!type) {
-                free(id);
-                astnode_free(attrs);
-                astnode_free(params);
+        if (!type)
                 return NULL;
-        }
 
         struct astnode *block;
         struct astnode *fdef;
@@ -471,13 +453,8 @@ struct astnode *parse_function_definition(struct parser *p)
 
                 struct astnode *expr = parse_expr(p);
 
-                if (!expr) {
-                        free(id);
-                        astnode_free(block);
-                        astnode_free(attrs);
-                        astnode_free(params);
+                if (!expr)
                         return NULL;
-                }
 
                 struct astnode *resolve = astnode_resolve(p->line, p->block, expr);
 
@@ -489,22 +466,15 @@ struct astnode *parse_function_definition(struct parser *p)
         }
 
         if (p->current.type != LX_LBRACE) {
-                printf("Expected '{' after function parameter block pr '=' for an expression-valued function. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                free(id);
-                astnode_free(attrs);
-                astnode_free(params);
+                printf("Expected '{' after function parameter block pr '=' for an expression-valued function. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
         block = parse_block(p);
 
-        if (!block) {
-                free(id);
-                astnode_free(attrs);
-                astnode_free(params);
+        if (!block)
                 return NULL;
-        }
 
         finalize:
 
@@ -512,42 +482,37 @@ struct astnode *parse_function_definition(struct parser *p)
         fdef->function_def.params->holder = fdef;
         fdef->function_def.block->holder = fdef;
 
-        free(id);
-
         return fdef;
 }
 
 struct astnode *parse_present(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || strcmp(p->current.value, "present") != 0) {
-                printf("Expected 'linked' at the beginning of a linked function definition. Got %s (\"%s\") error on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_PRESENT) {
+                printf("Expected 'linked' at the beginning of a linked function definition. Got %s (\"%.*s\") error on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
         parser_advance(p);
 
-        if (p->current.type != LX_IDEN) {
-                printf("Expected function identifier after linked keyword. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (!parser_name(p)) {
+                printf("Expected function identifier after linked keyword. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        char *id = strdup(p->current.value);
+        char *id = p->current.value;
 
         parser_advance(p);
 
         struct astnode *params = parse_parameters(p, false);
 
-        if (!params) {
-                free(id);
+        if (!params)
                 return NULL;
-        }
 
         if (p->current.type != LX_MOV_RIGHT) {
-                printf("Expected '->' after parameter block. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                free(id);
+                printf("Expected '->' after parameter block. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -555,22 +520,18 @@ struct astnode *parse_present(struct parser *p)
 
         struct astdtype *type = parse_type(p);
 
-        if (!type) {
-                astnode_free(params);
-                free(id);
+        if (!type)
                 return NULL;
-        }
 
         struct astnode *linked = astnode_present_function(p->line, p->block, id, params, type);
-        free(id);
         return linked;
 }
 
 struct astnode *parse_resolve(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || (p->current.type == LX_IDEN && strcmp(p->current.value, "resolve") != 0)) {
-                printf("Expected 'resolve' at the beginning of a resolution statement. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_RESOLVE) {
+                printf("Expected 'resolve' at the beginning of a resolution statement. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -589,9 +550,9 @@ struct astnode *parse_resolve(struct parser *p)
 
 struct astnode *parse_if(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || strcmp(p->current.value, "if") != 0) {
-                printf("Expected 'if' at the start of an if-statement. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_IF) {
+                printf("Expected 'if' at the start of an if-statement. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -610,7 +571,7 @@ struct astnode *parse_if(struct parser *p)
 
         struct astnode *branch_tip = base;
 
-        while (p->current.type == LX_IDEN && strcmp(p->current.value, "else") == 0) {
+        while (p->current.type == LX_IDEN && p->current.value == NAME(ELSE)) {
                 struct astnode *branch;
 
                 parser_advance(p);
@@ -618,22 +579,17 @@ struct astnode *parse_if(struct parser *p)
                 struct astnode *branch_condition = NULL;
                 struct astnode *branch_block;
 
-                if (p->current.type == LX_IDEN && strcmp(p->current.value, "if") == 0) {
+                if (p->current.type == LX_KW_IF) {
                         parser_advance(p);
                         branch_condition = parse_expr(p);
-                        if (!branch_condition) {
-                                astnode_free(base);
+                        if (!branch_condition)
                                 return NULL;
-                        }
                 }
 
                 branch_block = parse_block(p);
 
-                if (!branch_block) {
-                        astnode_free(branch_condition);
-                        astnode_free(base);
+                if (!branch_block)
                         return NULL;
-                }
 
                 branch = astnode_if(p->line, p->block, branch_condition, branch_block, NULL);
 
@@ -653,30 +609,51 @@ struct astnode *parse_if(struct parser *p)
 
 struct astnode *parse_include(struct parser *p)
 {
-        if (p->current.type != LX_IDEN || strcmp(p->current.value, "include") != 0) {
-                printf("Expected 'include' at the start of an include directive. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+        if (p->current.type != LX_KW_INCLUDE) {
+                printf("Expected 'include' at the start of an include directive. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
         parser_advance(p);
 
         if (p->current.type != LX_STRING) {
-                printf("Expected string literal after the include identifier. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+                printf("Expected string literal after the include identifier. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        struct astnode *include = astnode_include(p->line, p->block, p->current.value);
+        struct astnode *include = astnode_include(p->line, p->block, parser_token_string(p));
         parser_advance(p);
         return include;
 }
 
+struct astnode *parse_import(struct parser *p)
+{
+        if (p->current.type != LX_KW_IMPORT) {
+                printf("Expected 'import' at the start of an import directive. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
+                return NULL;
+        }
+
+        parser_advance(p);
+
+        if (p->current.type != LX_STRING) {
+                printf("Expected the module path as a string literal after the import identifier. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
+                return NULL;
+        }
+
+        struct astnode *import = astnode_import(p->line, p->block, parser_token_string(p));
+        parser_advance(p);
+        return import;
+}
+
 struct astnode *parse_attributes(struct parser *p)
 {
         if (p->current.type != LX_LSQUARE) {
-                printf("Expected '[' at the start of an attribute list, got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+                printf("Expected '[' at the start of an attribute list, got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -686,9 +663,8 @@ struct astnode *parse_attributes(struct parser *p)
 
         while (p->current.type != LX_RSQUARE) {
                 if (p->current.type != LX_IDEN) {
-                        printf("Expected a comma-separated list of attributes, got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        astnode_free(attrs);
+                        printf("Expected a comma-separated list of attributes, got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -711,9 +687,8 @@ struct astnode *parse_attributes(struct parser *p)
         }
 
         if (p->current.type != LX_RSQUARE) {
-                printf("Expected ']' at the end of an attribute list, got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                astnode_free(attrs);
+                printf("Expected ']' at the end of an attribute list, got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -726,13 +701,7 @@ static struct astdtype *actually_parse_type(struct parser *p)
 {
         char *identifier;
 
-        if (p->current.type != LX_IDEN) {
-                printf("Expected type name or functional identifier. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                return NULL;
-        }
-
-        if (strcmp(p->current.value, "void") == 0) {
+        if (p->current.type == LX_TYPE_VOID) {
                 parser_advance(p);
 
                 struct astdtype *v = astdtype_void();
@@ -740,9 +709,7 @@ static struct astdtype *actually_parse_type(struct parser *p)
                 return v;
         }
 
-        identifier = p->current.value;
-
-        enum builtin_type bt = builtin_from_string(identifier);
+        enum builtin_type bt = builtin_from_lxtype(p->current.type);
 
         if (bt != BUILTIN_UNDEFINED) {
                 parser_advance(p);
@@ -752,12 +719,20 @@ static struct astdtype *actually_parse_type(struct parser *p)
                 return builtin;
         }
 
-        if (strcmp(identifier, "ptr") == 0) {
+        if (!parser_name(p)) {
+                printf("Expected type name or functional identifier. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
+                return NULL;
+        }
+
+        identifier = p->current.value;
+
+        if (identifier == NAME(PTR)) {
                 parser_advance(p);
 
                 if (p->current.type != LX_LPAREN) {
-                        printf("Expected '(' after functional identifier. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
+                        printf("Expected '(' after functional identifier. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -769,8 +744,8 @@ static struct astdtype *actually_parse_type(struct parser *p)
                         return NULL;
 
                 if (p->current.type != LX_RPAREN) {
-                        printf("Expected ')' after enclosed type. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
+                        printf("Expected ')' after enclosed type. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -781,7 +756,7 @@ static struct astdtype *actually_parse_type(struct parser *p)
                 return pointer;
         }
 
-        struct astdtype *type = astdtype_complex(identifier);
+        struct astdtype *type = astdtype_complex(identifier, NULL);
         parser_advance(p);
 
         return type;
@@ -790,74 +765,76 @@ static struct astdtype *actually_parse_type(struct parser *p)
 
 struct astdtype *parse_type(struct parser *p)
 {
-        struct astdtype *type = actually_parse_type(p);
-        if (!type)
-                return NULL;
-        astnode_push_compound(p->types, astnode_data_type(type));
-        return type;
+        return actually_parse_type(p);
 }
 
 
-inline struct astnode *parse_expr(struct parser *p)
+// How tightly each binary operator binds, from 1 up. 0 (BOP_UNKNOWN) ends the expression.
+// Operators on the same level associate to the left. A new operator only needs a level here and a case in bop_from_lxtype
+#define BINDING_LEVELS 5
+
+static const uint8_t binding_power[BOP_COUNT] = {
+        [BOP_OR] = 1,
+        [BOP_AND] = 2,
+        [BOP_LGREATER] = 3,
+        [BOP_LGREQ] = 3,
+        [BOP_RGREATER] = 3,
+        [BOP_RGREQ] = 3,
+        [BOP_ADD] = 4,
+        [BOP_SUB] = 4,
+        [BOP_MUL] = 5,
+        [BOP_DIV] = 5
+};
+
+static struct astnode *fold_binary(struct parser *p, size_t line, struct astnode *left, struct astnode *right, enum binaryop op)
 {
-        return parse_additive_expr(p);
+        struct astnode *node = astnode_binary(line, p->block, left, right, op);
+        left->holder = node;
+        right->holder = node;
+        return node;
 }
 
-struct astnode *parse_additive_expr(struct parser *p)
+/**
+ * Operator precedence parsing without recursion. Operands waiting for their right-hand side are kept on a stack
+ * along with their operators, each binding tighter than the one below it, so the stack never holds more than one
+ * operator per level no matter how long the expression is.
+ **/
+struct astnode *parse_expr(struct parser *p)
 {
+        struct astnode *operands[BINDING_LEVELS];
+        enum binaryop operators[BINDING_LEVELS];
+        size_t depth = 0;
+
         size_t line = p->line;
-        struct astnode *left = parse_multiplicative_expr(p);
+        struct astnode *operand = parse_atom_front(p);
 
-        if (!left)
+        if (!operand)
                 return NULL;
 
-        while (p->current.type == LX_PLUS || p->current.type == LX_MINUS || p->current.type == LX_DOUBLE_AND ||
-               p->current.type == LX_DOUBLE_OR) {
+        while (true) {
                 enum binaryop op = bop_from_lxtype(p->current.type);
+                uint8_t power = binding_power[op];
 
-                parser_advance(p);
-
-                struct astnode *right = parse_additive_expr(p);
-
-                if (!right) {
-                        astnode_free(left);
-                        return NULL;
+                // Everything pending that binds at least as tightly gets its right-hand side now
+                while (depth > 0 && binding_power[operators[depth - 1]] >= power) {
+                        depth--;
+                        operand = fold_binary(p, line, operands[depth], operand, operators[depth]);
                 }
 
-                left = astnode_binary(line, p->block, left, right, op);
-                left->binary.left->holder = left;
-                left->binary.right->holder = left;
-        }
-
-        return left;
-}
-
-struct astnode *parse_multiplicative_expr(struct parser *p)
-{
-        size_t line = p->line;
-        struct astnode *left = parse_atom_front(p);
-
-        if (!left)
-                return NULL;
+                if (power == 0)
+                        return operand;
 
-        while (p->current.type == LX_ASTERISK || p->current.type == LX_SLASH || p->current.type == LX_LGREATER ||
-               p->current.type == LX_LGREQUAL || p->current.type == LX_RGREATER || p->current.type == LX_RGREQUAL) {
-
-                enum binaryop op = bop_from_lxtype(p->current.type);
+                operands[depth] = operand;
+                operators[depth] = op;
+                depth++;
 
                 parser_advance(p);
 
-                struct astnode *right = parse_multiplicative_expr(p);
+                operand = parse_atom_front(p);
 
-                if (!right) {
-                        astnode_free(left);
+                if (!operand)
                         return NULL;
-                }
-
-                left = astnode_binary(line, p->block, left, right, op);
         }
-
-        return left;
 }
 
 struct astnode *parse_atom_front(struct parser *p)
@@ -878,10 +855,8 @@ struct astnode *parse_atom_front(struct parser *p)
 
                 struct astnode *nextExpr = parse_atom(p);
 
-                if (!nextExpr) {
-                        astnode_free(root);
+                if (!nextExpr)
                         return NULL;
-                }
 
                 tip->path.next = astnode_path(p->line, p->block, nextExpr);
 
@@ -901,9 +876,8 @@ struct astnode *parse_atom(struct parser *p)
                         return NULL;
 
                 if (p->current.type != LX_RPAREN) {
-                        printf("Expected ')' after sub-expression. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        astnode_free(expr);
+                        printf("Expected ')' after sub-expression. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -921,40 +895,36 @@ struct astnode *parse_atom(struct parser *p)
         if (p->current.type == LX_IDEN && p->next.type == LX_LPAREN)
                 return parse_function_call(p);
 
-        if (p->current.type == LX_IDEN && strcmp(p->current.value, "true") == 0) {
+        if (p->current.type == LX_KW_TRUE) {
                 parser_advance(p);
                 return astnode_integer_literal(p->line, p->block, 1);
         }
 
-        if (p->current.type == LX_IDEN && strcmp(p->current.value, "false") == 0) {
+        if (p->current.type == LX_KW_FALSE) {
                 parser_advance(p);
                 return astnode_integer_literal(p->line, p->block, 0);
         }
 
-        if (p->current.type == LX_IDEN && (strcmp(p->current.value, "nothing") == 0)) {
+        if (p->current.type == LX_KW_NOTHING) {
                 parser_advance(p);
                 return astnode_void_placeholder(p->line, p->block);
         }
 
-        if (p->current.type == LX_IDEN &&
-            (strcmp(p->current.value, "ptr_to") == 0 || strcmp(p->current.value, "deref") == 0)) {
-                _Bool pointer = (strcmp(p->current.value, "ptr_to") == 0);
+        if (p->current.type == LX_KW_PTR_TO || p->current.type == LX_KW_DEREF) {
+                _Bool pointer = (p->current.type == LX_KW_PTR_TO);
 
-                char *keyword = strdup(p->current.value);
+                char *keyword = pointer ? "ptr_to" : "deref";
 
                 size_t line = p->line;
 
                 parser_advance(p);
 
                 if (p->current.type != LX_LSQUARE) {
-                        printf("Expected '[' after '%s' keyword. Got %s (\"%s\") on line %ld.\n",
-                               keyword, lxtype_string(p->current.type), p->current.value, p->line);
-                        free(keyword);
+                        printf("Expected '[' after '%s' keyword. Got %s (\"%.*s\") on line %ld.\n",
+                               keyword, lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
-                free(keyword);
-
                 parser_advance(p);
 
                 struct astnode *to = parse_expr(p);
@@ -963,8 +933,8 @@ struct astnode *parse_atom(struct parser *p)
                         return NULL;
 
                 if (p->current.type != LX_RSQUARE) {
-                        printf("Expected ']' after expression. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
+                        printf("Expected ']' after expression. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -980,14 +950,18 @@ struct astnode *parse_atom(struct parser *p)
                 return expr;
         }
 
+        // Any other keyword is just a name here
+        if (parser_name(p) && p->next.type == LX_LPAREN)
+                return parse_function_call(p);
+
         if (p->current.type == LX_IDEN) {
                 struct astnode *var = astnode_variable(p->line, p->block, p->current.value);
                 parser_advance(p);
                 return var;
         }
 
-        printf("Could not identify expression atom starting with %s (\"%s\") on line %ld.\n",
-               lxtype_string(p->current.type), p->current.value, p->line);
+        printf("Could not identify expression atom starting with %s (\"%.*s\") on line %ld.\n",
+               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
 
         return NULL;
 }
@@ -995,20 +969,19 @@ struct astnode *parse_atom(struct parser *p)
 struct astnode *parse_function_call(struct parser *p)
 {
         if (p->current.type != LX_IDEN) {
-                printf("Expected identifier at the start of a function call. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+                printf("Expected identifier at the start of a function call. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
         size_t line = p->line;
-        char *id = strdup(p->current.value);
+        char *id = p->current.value;
 
         parser_advance(p);
 
         if (p->current.type != LX_LPAREN) {
-                printf("Expected '(' after function identifier. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                free(id);
+                printf("Expected '(' after function identifier. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -1023,11 +996,8 @@ struct astnode *parse_function_call(struct parser *p)
 
                 expr = parse_expr(p);
 
-                if (!expr) {
-                        free(id);
-                        astnode_free(values);
+                if (!expr)
                         return NULL;
-                }
 
                 astnode_push_compound(values, expr);
 
@@ -1035,10 +1005,8 @@ struct astnode *parse_function_call(struct parser *p)
                         break;
 
                 if (p->current.type != LX_COMMA && p->next.type != LX_RPAREN) {
-                        printf("Expected ')' or ',' and more values. Got %s (\"%s\") on line %ld.\n",
-                               lxtype_string(p->current.type), p->current.value, p->line);
-                        free(id);
-                        astnode_free(values);
+                        printf("Expected ')' or ',' and more values. Got %s (\"%.*s\") on line %ld.\n",
+                               lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                         return NULL;
                 }
 
@@ -1047,10 +1015,8 @@ struct astnode *parse_function_call(struct parser *p)
         }
 
         if (p->current.type != LX_RPAREN) {
-                printf("Expected ')' at the end of a function call value list. Got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
-                free(id);
-                astnode_free(values);
+                printf("Expected ')' at the end of a function call value list. Got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -1059,16 +1025,14 @@ struct astnode *parse_function_call(struct parser *p)
         struct astnode *call = astnode_function_call(line, p->block, id, values);
         call->function_call.values->holder = call;
 
-        free(id);
-
         return call;
 }
 
 struct astnode *parse_number(struct parser *p)
 {
         if (p->current.type != LX_INTEGER && p->current.type != LX_DECIMAL) {
-                printf("Could not parse number. Expected integer literal or float literal, got %s (\"%s\") on line %ld.\n",
-                       lxtype_string(p->current.type), p->current.value, p->line);
+                printf("Could not parse number. Expected integer literal or float literal, got %s (\"%.*s\") on line %ld.\n",
+                       lxtype_string(p->current.type), TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
@@ -1077,9 +1041,11 @@ struct astnode *parse_number(struct parser *p)
         struct astnode *n;
 
         if (type == LX_INTEGER)
-                n = astnode_integer_literal(p->line, p->block, string_to_integer(p->current.value));
+                n = astnode_integer_literal(p->line, p->block, string_to_integer(TOKEN_START(p, p->current),
+                                                                                 p->current.length));
         else
-                n = astnode_float_literal(p->line, p->block, string_to_float(p->current.value));
+                n = astnode_float_literal(p->line, p->block, string_to_float(TOKEN_START(p, p->current),
+                                                                             p->current.length));
 
         parser_advance(p);
 
@@ -1089,12 +1055,12 @@ struct astnode *parse_number(struct parser *p)
 struct astnode *parse_string_literal(struct parser *p)
 {
         if (p->current.type != LX_STRING) {
-                printf("Expected string literal, but found %s (\"%s\") on line %ld.\n", lxtype_string(p->current.type),
-                       p->current.value, p->line);
+                printf("Expected string literal, but found %s (\"%.*s\") on line %ld.\n", lxtype_string(p->current.type),
+                       TOKEN_TEXT(p, p->current), p->line);
                 return NULL;
         }
 
-        struct astnode *str = astnode_string_literal(p->line, p->block, p->current.value);
+        struct astnode *str = astnode_string_literal(p->line, p->block, parser_token_string(p));
 
         parser_advance(p);
 
@@ -9,6 +9,9 @@
 
 struct astnode *parse(struct parser *);
 
+// Parse statements into an existing block
+struct astnode *parse_block_very_advanced(struct parser *, _Bool, struct astnode *);
+
 struct astnode *parse_block_advanced(struct parser *, _Bool);
 
 struct astnode *parse_block(struct parser *);
@@ -31,16 +34,14 @@ struct astnode *parse_if(struct parser *);
 
 struct astnode *parse_include(struct parser *);
 
+struct astnode *parse_import(struct parser *);
+
 struct astnode *parse_attributes(struct parser *);
 
 struct astdtype *parse_type(struct parser *);
 
 struct astnode *parse_expr(struct parser *);
 
-struct astnode *parse_additive_expr(struct parser *);
-
-struct astnode *parse_multiplicative_expr(struct parser *);
-
 struct astnode *parse_atom_front(struct parser *);
 
 struct astnode *parse_atom(struct parser *);